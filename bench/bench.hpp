@@ -0,0 +1,50 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "chip8.hpp"
+
+struct benchmark_t{
+    std::string name;
+    // runs the workload once, returns how many operations it performed
+    std::function<uint64_t()> fn;
+};
+
+std::vector<benchmark_t>& benchmarks();
+
+// keeps the compiler from dropping a result nobody reads
+template<class T>
+void do_not_optimize(const T& value){
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// adds a benchmark to benchmarks() during static initialization
+struct register_benchmark{
+    register_benchmark(std::string name, std::function<uint64_t()> fn){
+        benchmarks().push_back({std::move(name), std::move(fn)});
+    }
+};
+
+constexpr std::array<Chip8::backend_t, 5> BACKENDS{
+    Chip8::backend_t::interpreter,
+    Chip8::backend_t::predecoded,
+    Chip8::backend_t::opcode_table,
+    Chip8::backend_t::threaded,
+    Chip8::backend_t::jit_x64
+};
+
+// for benchmark names
+inline const char* backend_name(Chip8::backend_t b){
+    switch(b){
+        case Chip8::backend_t::interpreter: return "interpreter";
+        case Chip8::backend_t::predecoded: return "predecoded";
+        case Chip8::backend_t::opcode_table: return "opcode_table";
+        case Chip8::backend_t::threaded: return "threaded";
+        case Chip8::backend_t::jit_x64: return "jit_x64";
+    }
+    return "";
+}
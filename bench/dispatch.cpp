@@ -0,0 +1,71 @@
+#include "bench.hpp"
+#include "chip8.hpp"
+
+#include <memory>
+#include <random>
+
+// the cost of dispatching itself: the same instructions in an order the
+// host's branch predictors can learn and in one they can't. Run with --perf
+// to see the branch misses per instruction of each backend
+
+namespace{
+
+constexpr int CYCLES = 100000;
+// instructions in the loop, far more than the predictors can remember
+// for the random order
+constexpr int LENGTH = 1024;
+
+// cheap instructions of as many kinds as possible, none of them skips or
+// writes memory, so the loop always runs straight through
+constexpr std::array<uint16_t, 18> MIX{
+    0x6000, 0x7000, 0x8000, 0x8001, 0x8002, 0x8003, 0x8004, 0x8005, 0x8006,
+    0x8007, 0x800E, 0xA000, 0xC000, 0xF007, 0xF015, 0xF01E, 0xF029, 0x9000
+};
+
+std::vector<uint8_t> make_rom(bool random){
+    // fixed seed, the sequence is the same on every run
+    std::mt19937 gen(1);
+    std::vector<uint8_t> rom;
+    for(int i = 0; i < LENGTH; ++i){
+        uint16_t op = MIX[random ? gen() % MIX.size() : i % MIX.size()];
+        // registers below VF, which only holds flags
+        const uint16_t X = gen() % 15;
+        const uint16_t Y = gen() % 15;
+        switch(op >> 12){
+            // 9XX0 never skips
+            case 0x9: op |= X << 8 | X << 4; break;
+            case 0x8: op |= X << 8 | Y << 4; break;
+            case 0xA: op |= gen() & 0xFFF; break;
+            case 0xF: op |= X << 8; break;
+            default: op |= X << 8 | (gen() & 0xFF); break;
+        }
+        rom.push_back(op >> 8);
+        rom.push_back(op & 0xFF);
+    }
+    rom.push_back(0x12);
+    rom.push_back(0x00);
+    return rom;
+}
+
+// dispatch/<order>/<backend>, one op is one instruction
+const bool registered = []{
+    for(const bool random : {false, true}){
+        for(const auto b : BACKENDS){
+            const std::string name = std::string("dispatch/") + (random ? "random" : "periodic") + "/" + backend_name(b);
+            register_benchmark(name, [c = std::shared_ptr<Chip8>(), b, random]() mutable -> uint64_t{
+                if(!c){
+                    c = std::make_shared<Chip8>();
+                    c->load(make_rom(random));
+                    c->set_backend(b);
+                }
+                for(int done = 0; done < CYCLES;){
+                    done += c->run_cycles(CYCLES - done);
+                }
+                return CYCLES;
+            });
+        }
+    }
+    return true;
+}();
+
+}
@@ -0,0 +1,103 @@
+#include "bench.hpp"
+#include "chip8.hpp"
+
+namespace{
+
+constexpr int DRAWS = 4096;
+
+// positions and sprite rows shared by the kernel benchmarks
+struct draw_t{
+    uint8_t x;
+    uint8_t y;
+    std::array<uint8_t, 15> sprite;
+};
+
+const std::vector<draw_t>& draws(){
+    static const std::vector<draw_t> list = []{
+        std::vector<draw_t> l(DRAWS);
+        uint32_t seed = 0x12345678;
+        auto next = [&seed]{
+            seed = seed * 1664525 + 1013904223;
+            return uint8_t(seed >> 24);
+        };
+        for(auto& d : l){
+            d.x = next() % 64;
+            d.y = next() % 32;
+            for(auto& b : d.sprite){
+                b = next();
+            }
+        }
+        return l;
+    }();
+    return list;
+}
+
+// what DXYN used to do, one pixel at a time on a bitset
+uint64_t kernel_bitset(){
+    static std::bitset<64 * 32> screen;
+    uint64_t collisions = 0;
+
+    for(const auto& d : draws()){
+        for(int r = 0; r < 15 && d.y + r < 32; ++r){
+            const std::bitset<8> sprite_row = d.sprite[r];
+            for(int c = 0; c < 8 && d.x + c < 64; ++c){
+                const size_t pix = (d.y + r) * 64 + d.x + c;
+                if(sprite_row.test(7 - c)){
+                    collisions += screen.test(pix);
+                    screen.flip(pix);
+                }
+            }
+        }
+    }
+
+    do_not_optimize(collisions);
+    return DRAWS;
+}
+
+// same work on row-packed words, as DXYN does now
+uint64_t kernel_rows(){
+    static std::array<uint64_t, 32> screen{};
+    uint64_t collisions = 0;
+
+    for(const auto& d : draws()){
+        for(int r = 0; r < 15 && d.y + r < 32; ++r){
+            const uint64_t sprite_row = uint64_t(d.sprite[r]) << 56 >> d.x;
+            collisions += (screen[d.y + r] & sprite_row) != 0;
+            screen[d.y + r] ^= sprite_row;
+        }
+    }
+
+    do_not_optimize(collisions);
+    return DRAWS;
+}
+
+// endless loop drawing 15-row sprites at moving positions, 2 DXYN out of 5
+uint64_t sprite_rom(){
+    static const std::vector<uint8_t> rom{
+        0xA0, 0x00, // 200: I = 0x000
+        0xD0, 0x1F, // 202: draw V0, V1, 15 rows
+        0x70, 0x03, // 204: V0 += 3
+        0x71, 0x05, // 206: V1 += 5
+        0xD0, 0x1F, // 208: draw V0, V1, 15 rows
+        0x12, 0x02  // 20A: jump 202
+    };
+    constexpr int CYCLES = 100000;
+
+    static Chip8 c = []{
+        Chip8 c;
+        c.load(rom);
+        return c;
+    }();
+
+    for(int done = 0; done < CYCLES;){
+        done += c.run_cycles(CYCLES - done);
+    }
+
+    return CYCLES;
+}
+
+register_benchmark b1("dxyn/kernel_bitset", kernel_bitset);
+register_benchmark b2("dxyn/kernel_rows", kernel_rows);
+register_benchmark b3("dxyn/sprite_rom", sprite_rom);
+
+}
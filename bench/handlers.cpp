@@ -0,0 +1,128 @@
+#include "bench.hpp"
+#include "chip8.hpp"
+
+#include <memory>
+
+namespace{
+
+// copies of the instruction under test per loop, then a jump back
+constexpr int BODY = 32;
+constexpr int CYCLES = 100000;
+constexpr uint16_t LOOP = 0x240;
+
+// in opcodes, replaced by the address of the next instruction
+constexpr uint16_t NEXT = 0x0FFF;
+// in a 2NNN, replaced by the address of a 00EE
+constexpr uint16_t RETURN = 0x0FFE;
+
+struct handler_case_t{
+    const char* name;
+    // repeated until the loop holds BODY instructions
+    std::vector<uint16_t> body;
+    // run once before the loop, after V0..VE = 1..15 and I = 0x800
+    std::vector<uint16_t> setup = {};
+    uint16_t keys = 0;
+};
+
+// every instruction runs (no skip is taken), so that each one is counted
+const std::vector<handler_case_t> CASES{
+    {"00E0", {0x00E0}},
+    {"2NNN_00EE", {0x2000 | RETURN}},
+    {"1NNN", {0x1000 | NEXT}},
+    {"3XNN", {0x3005}},
+    {"4XNN", {0x4001}},
+    {"5XY0", {0x5010}},
+    {"6XNN", {0x6A55}},
+    {"7XNN", {0x7A01}},
+    {"8XY0", {0x8AB0}},
+    {"8XY1", {0x8AB1}},
+    {"8XY2", {0x8AB2}},
+    {"8XY3", {0x8AB3}},
+    {"8XY4", {0x8AB4}},
+    {"8XY5", {0x8AB5}},
+    {"8XY6", {0x8AB6}},
+    {"8XY7", {0x8AB7}},
+    {"8XYE", {0x8ABE}},
+    {"8XYN_mix", {0x8AB4, 0x8AC5, 0x8AB6, 0x8AC1, 0x8ABE, 0x8AC7, 0x8AB3, 0x8AC2}},
+    {"9XY0", {0x9000}},
+    {"ANNN", {0xA800}},
+    {"BNNN", {0xB000 | NEXT}},
+    {"CXNN", {0xCAFF}},
+    // x = 1 straddles two bytes of the row, sprites from the font
+    {"DXY1", {0xD011}, {0xA000}},
+    {"DXY8", {0xD018}, {0xA000}},
+    {"DXYF", {0xD01F}, {0xA000}},
+    {"DXYF_moving", {0xD01F, 0x7003, 0x7105}, {0xA000}},
+    {"EX9E", {0xE09E}},
+    {"EXA1", {0xE0A1}, {}, 1 << 1},
+    {"FX07", {0xFA07}},
+    {"FX15", {0xFA15}},
+    {"FX18", {0xFA18}},
+    {"FX1E", {0xFA1E}},
+    {"FX29", {0xFA29}},
+    {"FX33", {0xFA33}},
+    {"FX55_1", {0xF055}},
+    {"FX55_8", {0xF755}},
+    {"FX55_16", {0xFF55}},
+    {"FX65_1", {0xF065}},
+    {"FX65_8", {0xF765}},
+    {"FX65_16", {0xFF65}}
+};
+
+std::vector<uint8_t> make_rom(const handler_case_t& c){
+    std::vector<uint16_t> ops;
+    for(int x = 0; x < 15; ++x){
+        ops.push_back(0x6000 | x << 8 | (x + 1));
+    }
+    ops.push_back(0xA800);
+    ops.insert(ops.end(), c.setup.begin(), c.setup.end());
+    ops.push_back(0x1000 | LOOP);
+    ops.resize((LOOP - 0x200) / 2, 0x0000);
+
+    for(int i = 0; i < BODY; ++i){
+        ops.push_back(c.body[i % c.body.size()]);
+    }
+    ops.push_back(0x1000 | LOOP);
+    const uint16_t ret = 0x200 + ops.size() * 2;
+    ops.push_back(0x00EE);
+
+    std::vector<uint8_t> rom;
+    for(size_t i = 0; i < ops.size(); ++i){
+        uint16_t op = ops[i];
+        const uint16_t addr = 0x200 + i * 2;
+        if((op & 0xFFF) == NEXT){
+            // BNNN adds V0, which is 1
+            op = (op & 0xF000) | ((addr + 2 - (op >> 12 == 0xB)) & 0xFFF);
+        }
+        else if((op & 0xFFF) == RETURN){
+            op = (op & 0xF000) | ret;
+        }
+        rom.push_back(op >> 8);
+        rom.push_back(op & 0xFF);
+    }
+    return rom;
+}
+
+// handler/<case>/<backend>, one op is one instruction
+const bool registered = []{
+    for(const auto b : BACKENDS){
+        for(const handler_case_t& hc : CASES){
+            // built on the first run, which is the warm-up
+            register_benchmark(std::string("handler/") + hc.name + "/" + backend_name(b), [c = std::shared_ptr<Chip8>(), b, &hc]() mutable -> uint64_t{
+                if(!c){
+                    c = std::make_shared<Chip8>();
+                    c->load(make_rom(hc));
+                    c->set_backend(b);
+                    c->set_keyboard(hc.keys);
+                }
+                for(int done = 0; done < CYCLES;){
+                    done += c->run_cycles(CYCLES - done);
+                }
+                return CYCLES;
+            });
+        }
+    }
+    return true;
+}();
+
+}
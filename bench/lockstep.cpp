@@ -0,0 +1,91 @@
+#include "bench.hpp"
+#include "chip8.hpp"
+#include "lockstep.hpp"
+
+namespace{
+
+constexpr size_t LANES = 256;
+constexpr int FRAMES = 60;
+
+// ALU work, a draw, a key dependent branch, then waits for the next frame
+// on the delay timer like most games do
+const std::vector<uint8_t> rom{
+    0x6E, 0x05, // 200: VE = 5
+    0xA3, 0x00, // 202: I = 0x300
+    0x60, 0x05, // 204: V0 = 5
+    0x71, 0x01, // 206: V1 += 1
+    0x82, 0x14, // 208: V2 += V1
+    0x83, 0x26, // 20A: V3 = V2 >> 1
+    0x31, 0x05, // 20C: skip if V1 == 5
+    0x4F, 0x01, // 20E: skip if VF != 1
+    0xF0, 0x1E, // 210: I += V0
+    0x84, 0x52, // 212: V4 &= V5
+    0x85, 0x43, // 214: V5 ^= V4
+    0x94, 0x50, // 216: skip if V4 != V5
+    0x66, 0x00, // 218: V6 = 0
+    0xD0, 0x14, // 21A: draw V0, V1, 4 rows
+    0xEE, 0x9E, // 21C: skip if key 5
+    0x77, 0x01, // 21E: V7 += 1
+    0x68, 0x01, // 220: V8 = 1
+    0xF8, 0x15, // 222: delay = V8
+    0xF8, 0x07, // 224: V8 = delay
+    0x38, 0x00, // 226: skip if V8 == 0
+    0x12, 0x24, // 228: jump 224
+    0x12, 0x02  // 22A: jump 202
+};
+
+// key 5 held on some lanes, changing over time
+uint16_t keys(size_t lane, int frame){
+    return (lane * 7 + frame) % 3 == 0 ? 1 << 5 : 0;
+}
+
+template<bool with_keys>
+uint64_t separate(){
+    static std::vector<Chip8> chips = []{
+        std::vector<Chip8> c(LANES);
+        for(auto& chip : c){
+            chip.load(rom);
+        }
+        return c;
+    }();
+
+    uint64_t done = 0;
+    for(int f = 0; f < FRAMES; ++f){
+        for(size_t l = 0; l < LANES; ++l){
+            if constexpr(with_keys){
+                chips[l].set_keyboard(keys(l, f));
+            }
+            done += chips[l].run_frame();
+        }
+    }
+
+    return done;
+}
+
+template<bool with_keys>
+uint64_t lockstep(){
+    static Lockstep engine = []{
+        Lockstep e(LANES);
+        e.load(rom);
+        return e;
+    }();
+
+    uint64_t done = 0;
+    for(int f = 0; f < FRAMES; ++f){
+        if constexpr(with_keys){
+            for(size_t l = 0; l < LANES; ++l){
+                engine.set_keyboard(l, keys(l, f));
+            }
+        }
+        done += engine.run_frame();
+    }
+
+    return done;
+}
+
+register_benchmark b1("lockstep/separate_x256", separate<false>);
+register_benchmark b2("lockstep/engine_x256", lockstep<false>);
+register_benchmark b3("lockstep/separate_x256_keys", separate<true>);
+register_benchmark b4("lockstep/engine_x256_keys", lockstep<true>);
+
+}
@@ -0,0 +1,167 @@
+#include "bench.hpp"
+#include "perf_counters.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <print>
+#include <string_view>
+
+std::vector<benchmark_t>& benchmarks(){
+    static std::vector<benchmark_t> list;
+    return list;
+}
+
+namespace{
+
+struct result_t{
+    std::string name;
+    std::vector<double> samples; // ns/op
+    double median;
+    double min;
+    // per op over all the samples, see --perf
+    PerfCounters::counts_t perf;
+    uint64_t ops;
+};
+
+void usage(){
+    std::println(stderr, "usage: CHIP8emu_bench [filter] [--samples N] [--json out.json] [--perf]");
+}
+
+bool write_json(const char* path, const std::vector<result_t>& results, int samples){
+    std::FILE* f = std::fopen(path, "w");
+    if(!f){
+        return false;
+    }
+
+    std::println(f, "{{");
+    std::println(f, "  \"context\": {{");
+    std::println(f, "    \"compiler\": \"{}\",", __VERSION__);
+#ifdef NDEBUG
+    std::println(f, "    \"assertions\": false,");
+#else
+    std::println(f, "    \"assertions\": true,");
+#endif
+    std::println(f, "    \"samples\": {}", samples);
+    std::println(f, "  }},");
+    std::println(f, "  \"benchmarks\": [");
+    for(size_t i = 0; i < results.size(); ++i){
+        const result_t& r = results[i];
+        std::print(f, "    {{\"name\": \"{}\", \"unit\": \"ns/op\", \"median\": {:.4f}, \"min\": {:.4f}, \"samples\": [", r.name, r.median, r.min);
+        for(size_t s = 0; s < r.samples.size(); ++s){
+            std::print(f, "{}{:.4f}", s ? ", " : "", r.samples[s]);
+        }
+        std::print(f, "]");
+        // host events per op, only the available ones
+        bool first = true;
+        for(int e = 0; e < PerfCounters::EVENTS; ++e){
+            if(r.perf[e] >= 0){
+                std::print(f, "{}\"{}\": {:.4f}", first ? ", \"perf\": {" : ", ", PerfCounters::EVENT_NAMES[e], double(r.perf[e]) / r.ops);
+                first = false;
+            }
+        }
+        std::println(f, "{}}}{}", first ? "" : "}", i + 1 < results.size() ? "," : "");
+    }
+    std::println(f, "  ]");
+    std::println(f, "}}");
+
+    return std::fclose(f) == 0;
+}
+
+}
+
+int main(int argc, char** argv){
+    // optional substring filter on the benchmark names
+    std::string_view filter;
+    int samples = 10;
+    const char* json_path = nullptr;
+    bool perf = false;
+    for(int i = 1; i < argc; ++i){
+        const std::string_view arg = argv[i];
+        if(arg == "--samples" && i + 1 < argc){
+            const std::string_view n = argv[++i];
+            if(std::from_chars(n.data(), n.data() + n.size(), samples).ec != std::errc{} || samples < 1){
+                usage();
+                return 1;
+            }
+        }
+        else if(arg == "--json" && i + 1 < argc){
+            json_path = argv[++i];
+        }
+        else if(arg == "--perf"){
+            perf = true;
+        }
+        else if(arg.starts_with("--") || !filter.empty()){
+            usage();
+            return 1;
+        }
+        else{
+            filter = arg;
+        }
+    }
+    // every sample runs the workload for at least this long
+    constexpr auto SAMPLE_TIME = std::chrono::milliseconds(20);
+
+    // counts every sample of a benchmark, the warm-up excluded
+    std::unique_ptr<PerfCounters> counters;
+    if(perf){
+        counters = std::make_unique<PerfCounters>();
+        if(!counters->available()){
+            std::println(stderr, "Performance counters not available on this host");
+            counters.reset();
+        }
+    }
+
+    std::vector<result_t> results;
+    for(const auto& b : benchmarks()){
+        if(b.name.find(filter) == std::string::npos){
+            continue;
+        }
+
+        // warm up caches and branch predictors
+        b.fn();
+
+        result_t r{b.name, {}, 0, 0, {}, 0};
+        r.perf.fill(-1);
+        if(counters){
+            counters->start();
+        }
+        for(int s = 0; s < samples; ++s){
+            uint64_t ops = 0;
+            const auto start = std::chrono::steady_clock::now();
+            auto elapsed = std::chrono::steady_clock::duration::zero();
+            while(elapsed < SAMPLE_TIME){
+                ops += b.fn();
+                elapsed = std::chrono::steady_clock::now() - start;
+            }
+            r.samples.push_back(std::chrono::duration<double, std::nano>(elapsed).count() / ops);
+            r.ops += ops;
+        }
+        if(counters){
+            counters->stop();
+            r.perf = counters->read();
+        }
+
+        std::vector<double> sorted = r.samples;
+        std::ranges::sort(sorted);
+        const size_t mid = sorted.size() / 2;
+        r.median = sorted.size() % 2 ? sorted[mid] : (sorted[mid - 1] + sorted[mid]) / 2;
+        r.min = sorted.front();
+
+        std::print("{:<40} {:>10.2f} ns/op (min {:>10.2f}) {:>14} ops", r.name, r.median, r.min, r.ops);
+        for(int e = 0; e < PerfCounters::EVENTS; ++e){
+            if(r.perf[e] >= 0){
+                std::print("  {} {:.2f}", PerfCounters::EVENT_NAMES[e], double(r.perf[e]) / r.ops);
+            }
+        }
+        std::println("");
+        results.push_back(std::move(r));
+    }
+
+    if(json_path && !write_json(json_path, results, samples)){
+        std::println(stderr, "Couldn't write the file: {}", json_path);
+        return 1;
+    }
+}
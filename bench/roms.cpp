@@ -0,0 +1,64 @@
+#include "bench.hpp"
+#include "chip8.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+
+namespace{
+
+// 10 s of emulated time
+constexpr int FRAMES = 600;
+
+struct rom_t{
+    std::string name;
+    std::vector<uint8_t> data;
+};
+
+// every ROM in tests/, by name
+std::vector<rom_t> test_roms(){
+    std::vector<rom_t> roms;
+    std::error_code ec;
+    for(const auto& entry : std::filesystem::directory_iterator(CHIP8EMU_TESTS_DIR, ec)){
+        if(entry.path().extension() != ".ch8"){
+            continue;
+        }
+        std::ifstream in(entry.path(), std::ios::binary);
+        roms.push_back({entry.path().stem().string(), {std::istreambuf_iterator<char>(in), {}}});
+    }
+    std::ranges::sort(roms, {}, &rom_t::name);
+    return roms;
+}
+
+// rom/<name>/<backend>, FRAMES frames from power on. One op is one frame
+const bool registered = []{
+    for(const rom_t& rom : test_roms()){
+        for(const auto b : BACKENDS){
+            struct run_t{
+                Chip8 c;
+                Chip8::state_t power_on;
+            };
+            register_benchmark("rom/" + rom.name + "/" + backend_name(b), [r = std::shared_ptr<run_t>(), b, data = rom.data]() mutable -> uint64_t{
+                if(!r){
+                    r = std::make_shared<run_t>();
+                    r->c.load(data);
+                    r->c.set_backend(b);
+                    r->power_on = r->c.snapshot();
+                }
+                // the backend keeps what it decoded or compiled, like a
+                // long running session would
+                r->c.restore(r->power_on);
+                for(int f = 0; f < FRAMES; ++f){
+                    r->c.run_frame();
+                }
+                do_not_optimize(r->c.get_screen_hash());
+                return FRAMES;
+            });
+        }
+    }
+    return true;
+}();
+
+}
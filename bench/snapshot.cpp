@@ -0,0 +1,60 @@
+#include "bench.hpp"
+#include "chip8.hpp"
+
+namespace{
+
+constexpr int ROUND_TRIPS = 1000;
+
+const std::vector<uint8_t> rom{
+    0x22, 0x04, // 200: call 204
+    0x12, 0x00, // 202: jump 200
+    0x70, 0x01, // 204: V0 += 1
+    0xA4, 0x00, // 206: I = 0x400
+    0xF0, 0x33, // 208: BCD of V0 at 0x400
+    0xD0, 0x15, // 20A: draw V0, V1, 5 rows
+    0x00, 0xEE  // 20C: return
+};
+
+// a machine that has been running for a while, stopped inside the call
+Chip8 running(Chip8::backend_t backend, int cycles){
+    Chip8 c;
+    c.load(rom);
+    c.set_backend(backend);
+    for(int done = 0; done < cycles;){
+        done += c.run_cycles(cycles - done);
+    }
+    return c;
+}
+
+// snapshot() then restore() of the same state
+uint64_t round_trip(){
+    static Chip8 c = running(Chip8::backend_t::predecoded, 1003);
+
+    for(int i = 0; i < ROUND_TRIPS; ++i){
+        const Chip8::state_t s = c.snapshot();
+        do_not_optimize(s);
+        c.restore(s);
+    }
+
+    return ROUND_TRIPS;
+}
+
+// restores two states with different data in ram in turns, like a search
+// going back and forth between branches
+uint64_t alternate(){
+    static Chip8 c = running(Chip8::backend_t::predecoded, 1003);
+    static const Chip8::state_t a = running(Chip8::backend_t::predecoded, 1003).snapshot();
+    static const Chip8::state_t b = running(Chip8::backend_t::predecoded, 2006).snapshot();
+
+    for(int i = 0; i < ROUND_TRIPS; ++i){
+        c.restore(i & 1 ? b : a);
+        c.run_cycles(4);
+    }
+
+    return ROUND_TRIPS;
+}
+
+register_benchmark b1("snapshot/round_trip", round_trip);
+register_benchmark b2("snapshot/alternate_restore_run", alternate);
+
+}
@@ -0,0 +1,87 @@
+#include "frame_pacer.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <thread>
+
+#ifdef __linux__
+#include <time.h>
+#endif
+
+FramePacer::FramePacer(clock::duration period, int max_catch_up):
+    period(period),
+    max_catch_up(std::max(max_catch_up, 1)),
+    start(clock::now()),
+    last_wake(start)
+{}
+
+void FramePacer::sleep_until(clock::time_point deadline){
+    const auto wake = deadline - SPIN_MARGIN;
+    if(wake > clock::now()){
+#ifdef __linux__
+        // steady_clock is CLOCK_MONOTONIC on Linux
+        const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(wake.time_since_epoch()).count();
+        const timespec ts{
+            .tv_sec = static_cast<time_t>(ns / 1'000'000'000),
+            .tv_nsec = static_cast<long>(ns % 1'000'000'000)
+        };
+        while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR){}
+#else
+        std::this_thread::sleep_until(wake);
+#endif
+    }
+
+    while(clock::now() < deadline){
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+}
+
+void FramePacer::record(clock::time_point deadline, clock::time_point wake){
+    const double interval = std::chrono::duration<double, std::milli>(wake - last_wake).count();
+    const double lateness = std::chrono::duration<double, std::micro>(wake - deadline).count();
+    last_wake = wake;
+
+    ++stats.frames;
+    interval_sum += interval;
+    interval_sq_sum += interval * interval;
+    lateness_sum += lateness;
+    stats.interval_max_ms = std::max(stats.interval_max_ms, interval);
+    stats.lateness_max_us = std::max(stats.lateness_max_us, lateness);
+}
+
+int FramePacer::wait(){
+    const auto deadline = start + period * (deadline_index + 1);
+    auto now = clock::now();
+
+    if(now < deadline){
+        sleep_until(deadline);
+        ++deadline_index;
+        record(deadline, clock::now());
+        return 1;
+    }
+
+    // overrun: every deadline that went by is a frame to make up for
+    ++stats.overruns;
+    const uint64_t missed = (now - deadline) / period + 1;
+    deadline_index += missed;
+    record(deadline, now);
+
+    if(missed > uint64_t(max_catch_up)){
+        stats.skipped += missed - max_catch_up;
+        return max_catch_up;
+    }
+    return missed;
+}
+
+FramePacer::stats_t FramePacer::get_stats() const{
+    stats_t s = stats;
+    if(s.frames > 0){
+        s.interval_mean_ms = interval_sum / s.frames;
+        s.interval_stddev_ms = std::sqrt(std::max(0.0, interval_sq_sum / s.frames - s.interval_mean_ms * s.interval_mean_ms));
+        s.lateness_mean_us = lateness_sum / s.frames;
+    }
+    return s;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+class FramePacer{
+    /*
+        Paces a loop on absolute deadlines: deadline k is start + k * period,
+        so late wake-ups never accumulate into drift. It sleeps until
+        SPIN_MARGIN before the deadline and spins for the rest, since the
+        scheduler easily wakes threads up tens of microseconds late.
+
+        When a frame overruns, wait() returns immediately and asks for the
+        missed frames to be run back to back. If more than max_catch_up
+        deadlines went by, the extra frames are dropped instead.
+    */
+
+    public:
+    using clock = std::chrono::steady_clock;
+
+    struct stats_t{
+        uint64_t frames = 0;
+        uint64_t overruns = 0; // waits that found the deadline already gone
+        uint64_t skipped = 0; // frames dropped instead of caught up
+        // time between two wake-ups
+        double interval_mean_ms = 0;
+        double interval_stddev_ms = 0;
+        double interval_max_ms = 0;
+        // how late a wake-up is compared to its deadline
+        double lateness_mean_us = 0;
+        double lateness_max_us = 0;
+    };
+
+    explicit FramePacer(clock::duration period, int max_catch_up = 4);
+
+    // waits for the next deadline. Returns how many frames to run before
+    // calling it again: 1 when on time, up to max_catch_up after an overrun
+    int wait();
+    stats_t get_stats() const;
+
+    private:
+    static constexpr auto SPIN_MARGIN = std::chrono::microseconds(500);
+
+    clock::duration period;
+    int max_catch_up;
+    clock::time_point start;
+    uint64_t deadline_index = 0;
+    clock::time_point last_wake;
+
+    stats_t stats;
+    // running sums for the mean and the variance of the interval
+    double interval_sum = 0;
+    double interval_sq_sum = 0;
+    double lateness_sum = 0;
+
+    void sleep_until(clock::time_point deadline);
+    void record(clock::time_point deadline, clock::time_point wake);
+};
@@ -1,7 +1,94 @@
 #include "chip8.hpp"
+#include "frame_pacer.hpp"
+#include "renderer.hpp"
+#include "rewind.hpp"
+#include "trace_events.hpp"
+#include "triple_buffer.hpp"
 #include "SDL3/SDL.h"
 #include "SDL3/SDL_main.h"
 
+#include <atomic>
+#include <memory>
+#include <random>
+#include <string_view>
+#include <thread>
+
+// what the emulation thread hands to the render thread
+struct frame_t{
+    std::array<uint64_t, Chip8::SCREEN_HEIGHT> rows;
+    // rows that changed since the last frame the render thread took
+    uint32_t dirty_rows;
+    bool sound;
+};
+
+// keypad layout on a QWERTY keyboard:
+// 1 2 3 C      1 2 3 4
+// 4 5 6 D  ->  Q W E R
+// 7 8 9 E      A S D F
+// A 0 B F      Z X C V
+constexpr std::array<SDL_Scancode, 16> KEYMAP{
+    SDL_SCANCODE_X, SDL_SCANCODE_1, SDL_SCANCODE_2, SDL_SCANCODE_3,
+    SDL_SCANCODE_Q, SDL_SCANCODE_W, SDL_SCANCODE_E, SDL_SCANCODE_A,
+    SDL_SCANCODE_S, SDL_SCANCODE_D, SDL_SCANCODE_Z, SDL_SCANCODE_C,
+    SDL_SCANCODE_4, SDL_SCANCODE_R, SDL_SCANCODE_F, SDL_SCANCODE_V
+};
+// hold to run the game backwards
+constexpr SDL_Scancode REWIND_KEY = SDL_SCANCODE_BACKSPACE;
+// TraceEvents tracks, see --trace-events
+enum{
+    RENDER_TRACK,
+    EMULATION_TRACK
+};
+
+// runs on its own thread so that rendering hiccups don't change emulated timing
+void emulate(Chip8& c, FramePacer& pacer, TripleBuffer<frame_t>& frames, const std::atomic<uint16_t>& keypad, const std::atomic<bool>& rewinding, const std::atomic<bool>& running, TraceEvents* trace){
+    Rewind history;
+    Chip8::state_t state;
+    // rows of frames the render thread dropped, they go out with the next one
+    uint32_t unseen_rows = 0;
+    int frames_due = 1;
+    while(running.load(std::memory_order_relaxed)){
+        TraceEvents::scope_t frame_scope(trace, EMULATION_TRACK, "frame");
+        {
+            TraceEvents::scope_t scope(trace, EMULATION_TRACK, "emulate");
+            // more than one frame after an overrun, to catch up
+            for(int i = 0; i < frames_due; ++i){
+                if(rewinding.load(std::memory_order_relaxed)){
+                    // one frame back per frame, stays put at the oldest one
+                    if(history.step_back(state)){
+                        c.restore(state);
+                    }
+                    continue;
+                }
+                c.set_keyboard(keypad.load(std::memory_order_relaxed));
+                c.run_frame();
+                history.push(c.snapshot());
+            }
+        }
+
+        {
+            TraceEvents::scope_t scope(trace, EMULATION_TRACK, "publish");
+            frame_t& frame = frames.back_buffer();
+            const uint32_t dirty_rows = c.take_dirty_rows();
+            frame.rows = c.get_screen_rows();
+            frame.dirty_rows = unseen_rows | dirty_rows;
+            frame.sound = c.get_sound_timer() > 0;
+            unseen_rows = frames.publish() ? dirty_rows : unseen_rows | dirty_rows;
+        }
+
+        TraceEvents::scope_t scope(trace, EMULATION_TRACK, "sleep");
+        frames_due = pacer.wait();
+        if(trace && frames_due > 1){
+            // the deadline was already gone, value is the frames to catch up
+            trace->instant(EMULATION_TRACK, "overrun", frames_due - 1);
+        }
+    }
+
+    // the render thread may be waiting for a frame after it stopped running
+    // (the window was closed and the screen didn't change since), wake it up
+    frames.publish();
+}
+
 void SDLCALL callback(void *userdata, SDL_AudioStream *astream, int additional_amount, int total_amount){
     static int current_sine_sample = 0;
     additional_amount /= sizeof (float);  /* convert from bytes to samples */
@@ -27,10 +114,7 @@ void SDLCALL callback(void *userdata, SDL_AudioStream *astream, int additional_a
 }
 
 int main(int argc, char** argv){
-    int ips = 700; // instruction per second. 700 should be good
-    int refresh_rate = 60; // FPS
     Chip8 c;
-    const auto& screen = c.get_screen();
     std::FILE* f = std::fopen(argv[1], "r");
     if(!f){
         SDL_Log("Couldn't open the file: %s", argv[1]);
@@ -40,7 +124,41 @@ int main(int argc, char** argv){
     std::vector<uint8_t> rom(1 << 10);
     std::fread(rom.data(), sizeof(uint8_t), rom.size(), f);
 
-    c.load(rom);
+    // optional arguments after the ROM path
+    Chip8::backend_t backend = Chip8::backend_t::interpreter;
+    Chip8::quirks_t quirks = Chip8::quirks_t::modern;
+    const char* trace_events_path = nullptr;
+    for(int i = 2; i < argc; ++i){
+        const std::string_view arg = argv[i];
+        if(arg == "--trace-events" && i + 1 < argc){
+            trace_events_path = argv[++i];
+        }
+        else if(arg == "--predecoded"){
+            backend = Chip8::backend_t::predecoded;
+        }
+        else if(arg == "--opcode-table"){
+            backend = Chip8::backend_t::opcode_table;
+        }
+        else if(arg == "--threaded"){
+            backend = Chip8::backend_t::threaded;
+        }
+        else if(arg == "--jit"){
+            backend = Chip8::backend_t::jit_x64;
+        }
+        else if(arg == "--vip"){
+            quirks = Chip8::quirks_t::cosmac_vip;
+        }
+        else if(arg == "--schip"){
+            quirks = Chip8::quirks_t::schip;
+        }
+    }
+
+    c.load(rom, quirks);
+    // a different game every time
+    c.seed(std::random_device{}());
+    if(!c.set_backend(backend)){
+        SDL_Log("Backend not available on this host, using the interpreter");
+    }
 
     SDL_Window *window = NULL;
     SDL_Renderer *renderer = NULL;
@@ -57,11 +175,23 @@ int main(int argc, char** argv){
         return SDL_APP_FAILURE;
     }
 
-    if(!SDL_CreateWindowAndRenderer("examples/renderer/primitives", 1280, 720, 0, &window, &renderer)){
+    // 20x scale to begin with, the renderer keeps up with any resize
+    if(!SDL_CreateWindowAndRenderer(
+        "CHIP8emu",
+        Chip8::SCREEN_WIDTH * 20, Chip8::SCREEN_HEIGHT * 20,
+        SDL_WINDOW_RESIZABLE,
+        &window, &renderer
+    )){
         SDL_Log("Couldn't create window/renderer: %s", SDL_GetError());
         return SDL_APP_FAILURE;
     }
 
+    Renderer screen_renderer;
+    if(!screen_renderer.init(renderer)){
+        SDL_Log("Couldn't create the screen texture: %s", SDL_GetError());
+        return SDL_APP_FAILURE;
+    }
+
     stream = SDL_OpenAudioDeviceStream(SDL_AUDIO_DEVICE_DEFAULT_PLAYBACK, &spec, callback, 0);
     if(!stream){
         SDL_Log("Couldn't create audio stream: %s", SDL_GetError());
@@ -71,69 +201,125 @@ int main(int argc, char** argv){
     SDL_SetRenderDrawColor(renderer, 0, 0, 0, SDL_ALPHA_OPAQUE);  /* dark gray, full alpha */
     SDL_RenderClear(renderer);
     SDL_RenderPresent(renderer);
+    // the render loop runs at the display refresh rate
+    SDL_SetRenderVSync(renderer, 1);
+
+    TripleBuffer<frame_t> frames;
+    std::atomic<uint16_t> keypad = 0;
+    std::atomic<bool> rewinding = false;
+    std::atomic<bool> running = true;
+    FramePacer pacer(std::chrono::nanoseconds(1'000'000'000 / 60));
+    // phases of every frame of both loops, written at exit
+    std::unique_ptr<TraceEvents> trace;
+    if(trace_events_path){
+        trace = std::make_unique<TraceEvents>(std::initializer_list<const char*>{"render", "emulation"});
+    }
+    std::thread emulation(emulate, std::ref(c), std::ref(pacer), std::ref(frames), std::cref(keypad), std::cref(rewinding), std::cref(running), trace.get());
 
-    while(4){
-        // read key events and update keyboard
-        SDL_Event event;
-        while(SDL_PollEvent(&event)){
-            if (event.type == SDL_EVENT_QUIT){
-                goto exit;
+    bool sound = false;
+    bool redraw = true;
+    while(running){
+        TraceEvents::scope_t frame_scope(trace.get(), RENDER_TRACK, "frame");
+        {
+            TraceEvents::scope_t scope(trace.get(), RENDER_TRACK, "poll events");
+            // read key events and update keyboard
+            SDL_Event event;
+            while(SDL_PollEvent(&event)){
+                if (event.type == SDL_EVENT_QUIT){
+                    running = false;
+                }
+                // the window content has to be redrawn even if the screen didn't change
+                if(event.type == SDL_EVENT_WINDOW_EXPOSED || event.type == SDL_EVENT_WINDOW_PIXEL_SIZE_CHANGED){
+                    redraw = true;
+                }
+                if((event.type == SDL_EVENT_KEY_DOWN || event.type == SDL_EVENT_KEY_UP) && !event.key.repeat){
+                    if(event.key.scancode == REWIND_KEY){
+                        rewinding.store(event.type == SDL_EVENT_KEY_DOWN, std::memory_order_relaxed);
+                    }
+                    for(int k = 0; k < 16; ++k){
+                        if(KEYMAP[k] != event.key.scancode){
+                            continue;
+                        }
+                        if(event.type == SDL_EVENT_KEY_DOWN){
+                            keypad.fetch_or(1 << k, std::memory_order_relaxed);
+                        }
+                        else{
+                            keypad.fetch_and(~(1 << k), std::memory_order_relaxed);
+                        }
+                    }
+                }
             }
         }
 
-        auto start = std::chrono::high_resolution_clock().now();
-        for(int i = 0; i < ips / refresh_rate; ++i){
-            c.cpu_next_instr();
-        }
-        auto end = std::chrono::high_resolution_clock().now();
-        float active_time = std::chrono::duration<float, std::milli>(end - start).count();
-        assert(active_time < 16.67);
-        SDL_Delay(active_time < 16.67 ? static_cast<uint32_t>(16.67f - active_time) : 0);
-
-        // SDL render frame
-        SDL_SetRenderDrawColor(renderer, 0, 0, 0, SDL_ALPHA_OPAQUE);
-        SDL_RenderClear(renderer);
-        SDL_SetRenderDrawColor(renderer, 255, 255, 255, SDL_ALPHA_OPAQUE);
-
-        for(int i = 0; i < screen.size(); ++i){
-            const int x = i % 64;
-            const int y = i / 64;
-            SDL_FRect rect = {20.f * x, 20.f * y, 20, 20};
-            if(screen.test(i)){
-                SDL_RenderFillRect(renderer, &rect);
+        uint32_t dirty_rows = 0;
+        if(frames.update()){
+            const frame_t& frame = frames.front_buffer();
+            dirty_rows = frame.dirty_rows;
 
+            if(frame.sound != sound){
+                sound = frame.sound;
+                if(sound){
+                    SDL_ResumeAudioStreamDevice(stream);
+                }
+                else{
+                    SDL_PauseAudioStreamDevice(stream);
+                }
             }
         }
-        SDL_RenderPresent(renderer);
 
-        for(int i = 0; i < 32; ++i){
-            for(int j = 0; j < 64; ++j){
-                bool a = screen[i * 64 + j];
-                LOG("{}", a?"1":" ");
+        // SDL render frame, only when something changed
+        if(dirty_rows || redraw){
+            const auto& shown = frames.front_buffer().rows;
+            {
+                TraceEvents::scope_t scope(trace.get(), RENDER_TRACK, "render");
+                screen_renderer.draw(shown, dirty_rows);
             }
-            LOGLN("");
-        }
-        LOGLN("\n\n");
+            {
+                // blocks on vsync
+                TraceEvents::scope_t scope(trace.get(), RENDER_TRACK, "present");
+                SDL_RenderPresent(renderer);
+            }
+            redraw = false;
 
-        // decrement timers and play sound if necessary
-        if(c.get_delay_timer() > 0){
-            c.decrement_delay_timer();
+            for(int i = 0; i < 32; ++i){
+                for(int j = 0; j < 64; ++j){
+                    bool a = shown[i] >> (63 - j) & 1;
+                    LOG("{}", a?"1":" ");
+                }
+                LOGLN("");
+            }
+            LOGLN("\n\n");
+        }
+        else{
+            // nothing to present, so vsync won't pace this loop: sleep until
+            // the emulation thread publishes its next frame
+            TraceEvents::scope_t scope(trace.get(), RENDER_TRACK, "sleep");
+            frames.wait();
         }
+    }
 
-        if(c.get_sound_timer() > 0){
-            c.decrement_sound_timer();
+    emulation.join();
 
-            // play sound
-            if(c.get_sound_timer() > 0){
-                SDL_ResumeAudioStreamDevice(stream);
-            }
-            else{
-                SDL_PauseAudioStreamDevice(stream);
-            }
-        }
+    if(trace && !trace->write_json(trace_events_path)){
+        SDL_Log("Couldn't write the trace events: %s", trace_events_path);
     }
 
-exit:
+#ifdef CHIP8EMU_PROFILE
+    if(std::FILE* f = std::fopen("chip8_profile.json", "w")){
+        c.get_profile().write_json(f);
+        std::fclose(f);
+    }
+#endif
+
+    const FramePacer::stats_t stats = pacer.get_stats();
+    SDL_Log(
+        "%llu frames, %llu overruns, %llu skipped. Frame time %.3f ms (stddev %.3f, max %.3f), "
+        "wake-up lateness %.1f us (max %.1f)",
+        (unsigned long long)stats.frames, (unsigned long long)stats.overruns, (unsigned long long)stats.skipped,
+        stats.interval_mean_ms, stats.interval_stddev_ms, stats.interval_max_ms,
+        stats.lateness_mean_us, stats.lateness_max_us
+    );
+
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
 
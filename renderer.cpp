@@ -0,0 +1,94 @@
+#include "renderer.hpp"
+
+#include <bit>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+void expand_row(uint64_t row, uint32_t* out, uint32_t on, uint32_t off){
+    // one byte of the row at a time, its 8 bits become 8 pixels
+#if defined(__AVX2__)
+    const __m256i bits = _mm256_setr_epi32(0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+    const __m256i on_v = _mm256_set1_epi32(on);
+    const __m256i off_v = _mm256_set1_epi32(off);
+
+    for(int i = 0; i < 8; ++i){
+        const __m256i byte = _mm256_set1_epi32((row >> (56 - 8 * i)) & 0xFF);
+        const __m256i lit = _mm256_cmpeq_epi32(_mm256_and_si256(byte, bits), bits);
+        const __m256i px = _mm256_blendv_epi8(off_v, on_v, lit);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 8 * i), px);
+    }
+#elif defined(__SSE2__)
+    const __m128i hi_bits = _mm_setr_epi32(0x80, 0x40, 0x20, 0x10);
+    const __m128i lo_bits = _mm_setr_epi32(0x08, 0x04, 0x02, 0x01);
+    const __m128i on_v = _mm_set1_epi32(on);
+    const __m128i off_v = _mm_set1_epi32(off);
+
+    for(int i = 0; i < 8; ++i){
+        const __m128i byte = _mm_set1_epi32((row >> (56 - 8 * i)) & 0xFF);
+        const __m128i hi = _mm_cmpeq_epi32(_mm_and_si128(byte, hi_bits), hi_bits);
+        const __m128i lo = _mm_cmpeq_epi32(_mm_and_si128(byte, lo_bits), lo_bits);
+        // no blend before SSE4.1
+        _mm_storeu_si128(
+            reinterpret_cast<__m128i*>(out + 8 * i),
+            _mm_or_si128(_mm_and_si128(hi, on_v), _mm_andnot_si128(hi, off_v))
+        );
+        _mm_storeu_si128(
+            reinterpret_cast<__m128i*>(out + 8 * i + 4),
+            _mm_or_si128(_mm_and_si128(lo, on_v), _mm_andnot_si128(lo, off_v))
+        );
+    }
+#else
+    for(int x = 0; x < 64; ++x){
+        out[x] = (row >> (63 - x)) & 1 ? on : off;
+    }
+#endif
+}
+
+bool Renderer::init(SDL_Renderer* r){
+    renderer = r;
+    texture = SDL_CreateTexture(
+        renderer,
+        SDL_PIXELFORMAT_ARGB8888,
+        SDL_TEXTUREACCESS_STREAMING,
+        Chip8::SCREEN_WIDTH,
+        Chip8::SCREEN_HEIGHT
+    );
+    if(!texture){
+        return false;
+    }
+
+    // keep the pixels square and sharp whatever the window size
+    return SDL_SetTextureScaleMode(texture, SDL_SCALEMODE_NEAREST)
+        && SDL_SetRenderLogicalPresentation(
+            renderer,
+            Chip8::SCREEN_WIDTH,
+            Chip8::SCREEN_HEIGHT,
+            SDL_LOGICAL_PRESENTATION_LETTERBOX
+        );
+}
+
+void Renderer::draw(const std::array<uint64_t, Chip8::SCREEN_HEIGHT>& rows, uint32_t dirty_rows){
+    if(dirty_rows){
+        // a locked area must be rewritten entirely, so lock the span
+        // between the first and the last dirty row
+        const int first = std::countr_zero(dirty_rows);
+        const int last = 31 - std::countl_zero(dirty_rows);
+        const SDL_Rect area{0, first, Chip8::SCREEN_WIDTH, last - first + 1};
+
+        void* pixels;
+        int pitch;
+        if(SDL_LockTexture(texture, &area, &pixels, &pitch)){
+            for(int y = first; y <= last; ++y){
+                uint8_t* line = static_cast<uint8_t*>(pixels) + (y - first) * pitch;
+                expand_row(rows[y], reinterpret_cast<uint32_t*>(line), ON_COLOR, OFF_COLOR);
+            }
+            SDL_UnlockTexture(texture);
+        }
+    }
+
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, SDL_ALPHA_OPAQUE);
+    SDL_RenderClear(renderer);
+    SDL_RenderTexture(renderer, texture, NULL, NULL);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "chip8.hpp"
+#include "SDL3/SDL.h"
+
+// expands the 64 pixels of a packed screen row (column 0 in the most
+// significant bit) into 32-bit colors
+void expand_row(uint64_t row, uint32_t* out, uint32_t on, uint32_t off);
+
+class Renderer{
+    /*
+        Uploads the screen into a 64x32 streaming texture and lets SDL scale
+        it to the window with nearest-neighbour filtering: one upload and
+        one copy per frame, whatever the window size is.
+    */
+
+    SDL_Renderer* renderer = nullptr;
+    SDL_Texture* texture = nullptr;
+
+    public:
+    // ARGB8888
+    static constexpr uint32_t ON_COLOR = 0xFFFFFFFF;
+    static constexpr uint32_t OFF_COLOR = 0xFF000000;
+
+    Renderer() = default;
+    Renderer(const Renderer&) = delete;
+    Renderer& operator=(const Renderer&) = delete;
+
+    // the texture is owned by r and goes away with it
+    bool init(SDL_Renderer* r);
+    // uploads the rows set in dirty_rows (bit y for row y) and copies the
+    // texture to the render target, presenting is up to the caller
+    void draw(const std::array<uint64_t, Chip8::SCREEN_HEIGHT>& rows, uint32_t dirty_rows = ~0u);
+};
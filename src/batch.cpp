@@ -0,0 +1,132 @@
+#include "batch.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+Batch::Batch(unsigned threads, int slice_frames) : threads(threads), slice_frames(slice_frames){
+    if(this->threads == 0){
+        this->threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    assert(slice_frames > 0);
+}
+
+size_t Batch::add(job_t job){
+    states.push_back({.job = std::move(job), .chip8 = nullptr, .frame = 0});
+    results.emplace_back();
+    return states.size() - 1;
+}
+
+bool Batch::run_slice(size_t job){
+    state_t& s = states[job];
+    const auto start = std::chrono::steady_clock::now();
+
+    if(!s.chip8){
+        s.chip8 = std::make_unique<Chip8>();
+        s.chip8->load(s.job.rom, s.job.quirks);
+        s.chip8->seed(s.job.seed);
+        // falls back to the interpreter, results don't depend on the backend
+        s.chip8->set_backend(s.job.backend);
+    }
+
+    Chip8& c = *s.chip8;
+    result_t& r = results[job];
+    const uint64_t end = std::min(s.job.frames, s.frame + slice_frames);
+    for(; s.frame < end; ++s.frame){
+        if(!s.job.keys.empty()){
+            c.set_keyboard(s.job.keys[std::min<size_t>(s.frame, s.job.keys.size() - 1)]);
+        }
+        // fast-forwarded instructions included, taken out at the end
+        r.instructions += c.run_frame();
+    }
+
+    const bool done = s.frame == s.job.frames;
+    if(done){
+        r.skipped = c.get_skipped_cycles();
+        r.instructions -= r.skipped;
+        r.screen_hash = c.get_screen_hash();
+        s.chip8.reset();
+    }
+    r.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return !done;
+}
+
+void Batch::run(){
+    const size_t begin = pending_begin;
+    pending_begin = states.size();
+
+    std::vector<worker_t> workers(threads);
+    // round robin, the stealing takes care of uneven jobs
+    for(size_t j = begin; j < states.size(); ++j){
+        workers[(j - begin) % threads].slices.push_back(j);
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    {
+        std::vector<std::jthread> pool;
+        for(unsigned t = 0; t < threads; ++t){
+            pool.emplace_back([this, &workers, t]{ work(workers, t); });
+        }
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    uint64_t instructions = 0;
+    for(size_t j = begin; j < states.size(); ++j){
+        instructions += results[j].instructions;
+    }
+    stats.instructions = instructions;
+    stats.seconds = seconds;
+    stats.instructions_per_second = seconds > 0 ? instructions / seconds : 0;
+    stats.slices = 0;
+    stats.steals = 0;
+    for(const worker_t& w : workers){
+        stats.slices += w.slices_run;
+        stats.steals += w.steals;
+    }
+}
+
+void Batch::work(std::vector<worker_t>& workers, unsigned self){
+    worker_t& own = workers[self];
+    while(true){
+        size_t job;
+        bool found = false;
+        {
+            std::lock_guard lock(own.mutex);
+            if(!own.slices.empty()){
+                job = own.slices.back();
+                own.slices.pop_back();
+                found = true;
+            }
+        }
+        // steal the oldest slice of the next busy worker
+        for(unsigned i = 1; i < workers.size() && !found; ++i){
+            worker_t& victim = workers[(self + i) % workers.size()];
+            std::lock_guard lock(victim.mutex);
+            if(!victim.slices.empty()){
+                job = victim.slices.front();
+                victim.slices.pop_front();
+                found = true;
+                ++own.steals;
+            }
+        }
+        if(!found){
+            // every job left is running on another worker, which pushes it
+            // back to its own deque and keeps going with it
+            return;
+        }
+
+        ++own.slices_run;
+        if(run_slice(job)){
+            std::lock_guard lock(own.mutex);
+            own.slices.push_back(job);
+        }
+    }
+}
+
+const std::vector<Batch::result_t>& Batch::get_results() const{
+    return results;
+}
+
+const Batch::stats_t& Batch::get_stats() const{
+    return stats;
+}
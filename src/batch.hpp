@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "chip8.hpp"
+
+class Batch{
+    /*
+        Runs many independent Chip8 instances on a work-stealing thread pool.
+
+        Every job is cut in slices of slice_frames frames. A worker pops
+        slices from the back of its own deque and pushes the job back there
+        when the slice is done, so a job tends to stay on the same core.
+        An idle worker steals from the front of the other deques, and
+        leaves once they are all empty: the jobs still running then stay
+        with the workers running them.
+    */
+
+    public:
+    struct job_t{
+        std::vector<uint8_t> rom;
+        Chip8::quirks_t quirks = Chip8::quirks_t::modern;
+        Chip8::backend_t backend = Chip8::backend_t::interpreter;
+        uint64_t frames = 600;
+        // keypad state for each frame (see Chip8::set_keyboard()), the last
+        // one is held until the end. Empty means no key is ever pressed
+        std::vector<uint16_t> keys;
+        uint64_t seed = Chip8::DEFAULT_SEED; // see Chip8::seed()
+    };
+
+    struct result_t{
+        uint64_t instructions = 0; // interpreted ones only
+        uint64_t skipped = 0; // fast-forwarded by Chip8::run_frame()
+        uint64_t screen_hash = 0;
+        double seconds = 0; // spent running this job, summed over slices
+    };
+
+    struct stats_t{
+        uint64_t instructions = 0; // interpreted, summed over the jobs
+        double seconds = 0; // wall clock
+        double instructions_per_second = 0;
+        uint64_t slices = 0;
+        uint64_t steals = 0;
+    };
+
+    // threads == 0 uses one thread per hardware thread
+    explicit Batch(unsigned threads = 0, int slice_frames = 60);
+
+    // returns the index of the job in get_results()
+    size_t add(job_t job);
+    // runs every job added since the last run() to completion
+    void run();
+    const std::vector<result_t>& get_results() const;
+    const stats_t& get_stats() const;
+
+    private:
+    struct state_t{
+        job_t job;
+        std::unique_ptr<Chip8> chip8; // created by the first slice, freed after the last
+        uint64_t frame = 0;
+    };
+
+    // own cache line, the counters are bumped on every slice
+    struct alignas(64) worker_t{
+        std::mutex mutex;
+        std::deque<size_t> slices; // job indices
+        // only touched by the owner
+        uint64_t slices_run = 0;
+        uint64_t steals = 0;
+    };
+
+    unsigned threads;
+    int slice_frames;
+    std::vector<state_t> states;
+    std::vector<result_t> results;
+    size_t pending_begin = 0; // first job not run yet
+    stats_t stats;
+
+    // false when the job is over
+    bool run_slice(size_t job);
+    void work(std::vector<worker_t>& workers, unsigned self);
+};
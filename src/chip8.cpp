@@ -1,330 +1,539 @@
 #include "chip8.hpp"
+#include "instructions.hpp"
 
-void Chip8::load(const std::vector<uint8_t>& prog){
-    assert(prog.size() < MAX_PROG_SIZE);
+bool Chip8::load(const std::vector<uint8_t>& prog, quirks_t q){
+    if(prog.size() > MAX_PROG_SIZE){
+        return false;
+    }
     std::memcpy(&ram[PC_RESET_VALUE], prog.data(), prog.size());
+
+    if(q != quirks){
+        // decoded handlers and compiled blocks belong to the old profile
+        invalidate_code(0, RAM_SIZE);
+        quirks = q;
+        select_step();
+    }
+    else{
+        invalidate_code(PC_RESET_VALUE, prog.size());
+    }
+    return true;
 }
 
-void Chip8::handle_0_instr(const instruction_t& instr){
-    switch(instr.NNN){
-        // clear screen
-        case 0x0E0:
-            screen.reset();
-        break;
-        // return from subroutine
-        case 0x0EE:
-            PC = stack.top();
-            stack.pop();
-        break;
-        // 0NNN
-        default:
-            LOGLN("Unreachable! Instruction 0x0{:03X}", instr.NNN);
-            std::unreachable();
+Chip8::state_t Chip8::snapshot() const{
+    state_t s;
+    s.screen = screen;
+    s.ram = ram;
+    s.stack = stack;
+    s.SP = SP;
+    s.fault = fault;
+    s.PC = PC;
+    s.I = I;
+    s.keyboard = keyboard;
+    s.V = V;
+    s.delay_timer = delay_timer;
+    s.sound_timer = sound_timer;
+    s.quirks = quirks;
+    s.rng = rng.get_state();
+    return s;
+}
+
+void Chip8::restore(const state_t& s){
+    if(s.quirks != quirks){
+        invalidate_code(0, RAM_SIZE);
+        quirks = s.quirks;
+        select_step();
     }
-};
+    else if(std::memcmp(ram.data(), s.ram.data(), RAM_SIZE) != 0){
+        // only the code in the blocks that differ has to go, runs of
+        // changed blocks are dropped at once
+        constexpr size_t BLOCK = 64;
+        size_t changed_from = RAM_SIZE;
+        for(size_t a = 0; a <= RAM_SIZE; a += BLOCK){
+            const bool changed = a < RAM_SIZE && std::memcmp(&ram[a], &s.ram[a], BLOCK) != 0;
+            if(changed && changed_from == RAM_SIZE){
+                changed_from = a;
+            }
+            else if(!changed && changed_from != RAM_SIZE){
+                invalidate_code(changed_from, a - changed_from);
+                changed_from = RAM_SIZE;
+            }
+        }
+    }
+    ram = s.ram;
 
-void Chip8::handle_1_instr(const instruction_t& instr){
-    // only 1NNN here, JMP
-    PC = instr.NNN;
+    for(int y = 0; y < SCREEN_HEIGHT; ++y){
+        dirty_rows |= uint32_t(screen[y] != s.screen[y]) << y;
+    }
+    screen = s.screen;
+    ++draw_generation;
+
+    stack = s.stack;
+    SP = s.SP;
+    fault = s.fault;
+    PC = s.PC;
+    I = s.I;
+    keyboard = s.keyboard;
+    V = s.V;
+    delay_timer = s.delay_timer;
+    sound_timer = s.sound_timer;
+    rng.set_state(s.rng);
+    events = 0;
 }
 
-void Chip8::handle_2_instr(const instruction_t& instr){
-    // only 2NNN, jump to subroutine
-    stack.push(PC);
-    PC = instr.NNN;
+void Chip8::seed(uint64_t s){
+    rng.seed(s);
 }
 
-void Chip8::handle_3_instr(const instruction_t& instr){
-    // only 3XNN, skip conditionally
-    if(V[instr.X] == instr.NN){
-        PC += 2;
+bool Chip8::set_backend(backend_t b){
+#ifndef CHIP8EMU_COMPUTED_GOTO
+    if(b == backend_t::threaded){
+        return false;
     }
+#endif
+    if(b == backend_t::jit_x64){
+        auto j = std::make_unique<JitX64>();
+        if(!j->available()){
+            return false;
+        }
+        jit = std::move(j);
+    }
+    else{
+        jit.reset();
+    }
+
+    backend = b;
+    select_step();
+    return true;
 }
 
-void Chip8::handle_4_instr(const instruction_t& instr){
-    // only 4XNN, skip conditionally
-    if(V[instr.X] != instr.NN){
-        PC += 2;
-    }
+void Chip8::set_tracer(Tracer* t){
+    tracer = t;
+    select_step();
 }
 
-void Chip8::handle_5_instr(const instruction_t& instr){
-    // only 5XY0, skip conditionally
-    if(V[instr.X] == V[instr.Y]){
-        PC += 2;
+void Chip8::invalidate_code(uint16_t addr, size_t len){
+    if(len == 0){
+        return;
+    }
+    addr &= ADDR_MASK;
+    // FX33 / FX55 write around the end of ram onto its beginning
+    if(addr + len > RAM_SIZE){
+        invalidate_code(0, addr + len - RAM_SIZE);
+        len = RAM_SIZE - addr;
+    }
+    for(size_t i = addr / 2; i <= (addr + len - 1) / 2 && i < decoded.size(); ++i){
+        decoded[i].fn = nullptr;
+    }
+
+    if(jit){
+        jit->invalidate(addr, len);
     }
 }
 
-void Chip8::handle_6_instr(const instruction_t& instr){
-    // only 6XNN, set register
-    V[instr.X] = instr.NN;
+void Chip8::raise_fault(fault_t f){
+    PC -= 2;
+    fault = f;
+    events |= EVENT_FAULT;
 }
 
-void Chip8::handle_7_instr(const instruction_t& instr){
-    // only 7XNN, add to register
-    V[instr.X] += instr.NN;
+void Chip8::drew(uint32_t rows){
+    dirty_rows |= rows;
+    ++draw_generation;
 }
 
-void Chip8::handle_8_instr(const instruction_t& instr){
-    uint8_t tmp;
-    switch(instr.N){
-        // 8XY0, X = Y
-        case 0x0:
-            V[instr.X] = V[instr.Y];
-        break;
-        // 8XY1, X |= Y
-        case 0x1:
-            V[instr.X] |= V[instr.Y];
-        break;
-        // 8XY2, X &= Y
-        case 0x2:
-            V[instr.X] &= V[instr.Y];
-        break;
-        // 8XY3, X ^= Y
-        case 0x3:
-            V[instr.X] ^= V[instr.Y];
-        break;
-        // 8XY4, X += Y
-        case 0x4:
-            tmp = V[instr.X];
-            V[instr.X] += V[instr.Y];
+void Chip8::count_skip(){
+    PROFILE(profile.count_skip());
+}
 
-            // set VF to 1 in case of overflow
-            V[0xF] = (V[instr.X] < tmp);
-        break;
-        // 8XY5, V[X] = V[X] - V[Y]
-        case 0x5:
-            tmp = V[instr.X];
-            V[instr.X] -= V[instr.Y];
+void Chip8::count_draw(){
+    PROFILE(profile.count_draw());
+}
 
-            // set VF to 0 in case of underflow
-            V[0xF] = !(V[instr.X] > tmp);
-        break;
-        // 8XY6, optionally X=Y, X >>= 1, VF set to the bit
-        case 0x6:
-            if(copy_vy_to_vx_in_shift){
-                V[instr.X] = V[instr.Y];
-            }
-            tmp = V[instr.X] & 0x1;
-            V[instr.X] >>= 1;
-            V[0xF] = tmp;
-        break;
-        // 8XY7, V[X] = V[Y] - V[X]
-        case 0x7:
-            V[instr.X] = V[instr.Y] - V[instr.X];
+bool Chip8::is_idle_loop(const std::array<uint8_t, RAM_SIZE>& ram, uint16_t PC, uint16_t jump_addr){
+    // 1NNN to itself
+    if(PC == jump_addr){
+        return true;
+    }
 
-            // set VF to 0 in case of underflow
-            V[0xF] = !(V[instr.X] > V[instr.Y]);
-        break;
+    // FX07, 3XNN / 4XNN, 1NNN back to FX07: the delay timer is polled
+    // but it only changes on the next tick, so the skip can't happen
+    if(PC + 4 == jump_addr){
+        const uint8_t X = ram[PC] & 0xF;
+        const uint8_t skip = ram[PC + 2] >> 4;
+        return ram[PC] >> 4 == 0xF && ram[PC + 1] == 0x07
+            && (skip == 0x3 || skip == 0x4) && (ram[PC + 2] & 0xF) == X;
+    }
 
+    return false;
+}
 
-        // 8XYE, optionally X=Y, X <<= 1, VF set to the bit
-        case 0xE:
-            if(copy_vy_to_vx_in_shift){
-                V[instr.X] = V[instr.Y];
-            }
-            tmp = V[instr.X] >> 7;
-            V[instr.X] <<= 1;
-            V[0xF] = tmp;
-        break;
+template<class Q, op_t OP>
+void Chip8::execute_fn(Chip8& c, uint16_t opcode){
+    execute<Q, OP>(c, opcode);
+}
 
-        default:
-            LOGLN("Unreachable: instruction 0x8{:03X}",
-                std::bit_cast<uint32_t>(instr.NNN)
-            );
-            std::unreachable();
-        break;
-    }
+template<class Q>
+const std::array<Chip8::op_fn_t, 0x10000>& Chip8::op_table(){
+    // 512 KiB per quirk profile, the entries of the opcodes a ROM uses are
+    // the only ones that end up in the cache
+    static constexpr auto table = []{
+        constexpr auto fns = []<size_t... op>(std::index_sequence<op...>){
+            return std::array<op_fn_t, OPS>{&execute_fn<Q, op_t(op)>...};
+        }(std::make_index_sequence<OPS>{});
+
+        std::array<op_fn_t, 0x10000> t{};
+        for(size_t opcode = 0; opcode < t.size(); ++opcode){
+            t[opcode] = fns[decode_op(opcode)];
+        }
+        return t;
+    }();
+    return table;
 }
 
-void Chip8::handle_9_instr(const instruction_t& instr){
-    // only 9XY0, skip conditionally
-    if(V[instr.X] != V[instr.Y]){
-        PC += 2;
+void Chip8::log_state() const{
+    LOGLN(
+        "CHIP8 internal state:\n\tPC: 0x{:04X} -  "
+        "I: 0x{:04X}",
+        PC,
+        I
+    );
+    for(int i = 0; i < 16; i += 4){
+        LOG("\tV{:0X}: 0x{:02X} - ", i, V[i]);
+        LOG("V{:0X}: 0x{:02X} - ", i+1, V[i+1]);
+        LOG("V{:0X}: 0x{:02X} - ", i+2, V[i+2]);
+        LOGLN("V{:0X}: 0x{:02X}", i+3, V[i+3]);
     }
 }
 
-void Chip8::handle_A_instr(const instruction_t& instr){
-    // only ANNN, I = NNN
-    I = instr.NNN;
+template<class Q>
+int Chip8::step_interpreter(int){
+    log_state();
+
+    // Fetch
+    PC &= ADDR_MASK;
+    const uint16_t tmp = ram[PC] << 8 | ram[(PC + 1) & ADDR_MASK];
+    PC += 2;
+
+    LOGLN("Current instruction: 0x{:0X}", tmp);
+
+    PROFILE(profile.count(PC - 2, tmp));
+
+    // Decode, then execute
+    execute_opcode<Q>(*this, tmp);
+
+    return 1;
 }
 
-void Chip8::handle_B_instr(const instruction_t& instr){
-    // only BNNN, PC = NNN + V0 (default)
-    // or BXNN, PC = V[X] + XNN
-    uint8_t reg = 0;
-    if(make_BNNN_into_BXNN){
-        reg = instr.X;
+template<class Q>
+int Chip8::step_predecoded(int max_instr){
+    PC &= ADDR_MASK;
+    // odd addresses are rare enough to always take the slow path
+    if(PC & 1){
+        return step_interpreter<Q>(max_instr);
+    }
+
+    log_state();
+
+    decoded_t& d = decoded[PC / 2];
+    if(!d.fn){
+        d.opcode = ram[PC] << 8 | ram[PC + 1];
+        d.fn = op_table<Q>()[d.opcode];
     }
+    PROFILE(profile.count(PC, d.opcode));
+    PC += 2;
+    d.fn(*this, d.opcode);
 
-    PC = V[reg] + instr.NNN;
+    return 1;
 }
 
-void Chip8::handle_C_instr(const instruction_t& instr){
-    static std::random_device rd;
-    static std::mt19937 gen(rd());
-    static std::uniform_int_distribution<> distrib(0, 255);
+template<class Q>
+int Chip8::step_table(int){
+    log_state();
 
-    // only CXNN, VX = rand() & NN
-    V[instr.X] = distrib(gen) & instr.NN;
+    PC &= ADDR_MASK;
+    const uint16_t opcode = ram[PC] << 8 | ram[(PC + 1) & ADDR_MASK];
+    LOGLN("Current instruction: 0x{:0X}", opcode);
+    PROFILE(profile.count(PC, opcode));
+    PC += 2;
+    op_table<Q>()[opcode](*this, opcode);
+
+    return 1;
 }
 
-void Chip8::handle_D_instr(const instruction_t& instr){
-    // only DXYN, draw sprite on screen
-    uint8_t x = V[instr.X] % 64; // col
-    uint8_t y = V[instr.Y] % 32; // row
-    V[0xF] = 0;
+template<class Q>
+int Chip8::step_jit(int max_instr){
+    PC &= ADDR_MASK;
+    const auto& block = jit->get_block(ram.data(), PC, Q::copy_vy_to_vx_in_shift);
+    if(block.code && block.len <= max_instr){
+        PROFILE(profile.count_block(PC, block.len));
+        PC = block.code(V.data(), &I, &delay_timer);
+        return block.len;
+    }
 
-    std::bitset<8> sprite_row;
+    return step_interpreter<Q>(max_instr);
+}
 
-    for(int r = 0; r < instr.N && y + r < 32; ++r){
-        sprite_row = ram[I + r];
+template<class Q>
+int Chip8::step_traced(int max_instr){
+    const uint16_t pc = PC & ADDR_MASK;
+    const uint16_t opcode = ram[pc] << 8 | ram[(pc + 1) & ADDR_MASK];
+    const auto before = V;
 
-        for(int c = 0; c < 8 && x + c < 64; ++c){
-            size_t screen_pix = (y + r) * 64 + x + c;
-            if(sprite_row.test(7 - c)){
-                if(screen.test(screen_pix)){
-                    V[0xF] = 1;
-                }
-                screen.flip(screen_pix);
-            }
+    const int done = step_interpreter<Q>(max_instr);
+
+    Tracer::record_t r{pc, opcode, I, Tracer::NO_REG, 0};
+    for(int x = 0; x < GPREG_NUM; ++x){
+        if(V[x] != before[x]){
+            r.reg = x;
+            r.value = V[x];
+            break;
         }
     }
+    tracer->push(r);
+    return done;
 }
 
-void Chip8::handle_E_instr(const instruction_t& instr){
-    switch(instr.NN){
-        // EX9E, Skip if key
-        case 0x9E:
-            if(keyboard.test(V[instr.X])){
-                PC += 2;
-            }
-        break;
-        // EXA1: Skip if NOT key
-        case 0xA1:
-            if(!keyboard.test(V[instr.X])){
-                PC += 2;
-            }
-        break;
-        default:
-            LOGLN("Unreachable: instruction 0xE{:03X}", instr.NNN);
-            std::unreachable();
+template<auto step_fn>
+int Chip8::run_loop(int n){
+    // step_fn is a constant here, so the step gets inlined into the loop
+    events = 0;
+    int done = 0;
+    while(done < n){
+        done += (this->*step_fn)(n - done);
+        if(events){
+            break;
+        }
     }
+
+    return done;
 }
 
-void Chip8::handle_F_instr(const instruction_t& instr){
-    switch(instr.NN){
-        // FX07, reads delay timer and stores it into V[X]
-        case 0x7:
-            V[instr.X] = delay_timer;
-        break;
-        // FX0A, wait until a key is pressed and store it in V[X]
-        case 0xA:
-            for(int i = 0; i < keyboard.size(); ++i){
-                if(keyboard.test(i)){
-                    V[instr.X] = i;
-                    return;
-                }
+#ifdef CHIP8EMU_COMPUTED_GOTO
+template<class Q>
+int Chip8::run_threaded(int n){
+    // same order as op_t
+    static const void* const labels[OPS]{
+        &&op_00E0, &&op_00EE,
+        &&op_0NNN, &&op_1NNN, &&op_2NNN, &&op_3XNN, &&op_4XNN, &&op_5XY0, &&op_6XNN, &&op_7XNN,
+        &&op_8XY0, &&op_8XY1, &&op_8XY2, &&op_8XY3, &&op_8XY4, &&op_8XY5, &&op_8XY6, &&op_8XY7, &&op_8XYE,
+        &&op_9XY0, &&op_ANNN, &&op_BNNN, &&op_CXNN, &&op_DXYN, &&op_EX9E, &&op_EXA1,
+        &&op_FX07, &&op_FX0A, &&op_FX15, &&op_FX18, &&op_FX1E, &&op_FX29, &&op_FX33, &&op_FX55, &&op_FX65, &&op_none
+    };
+    // op_t of the opcodes, indexed by their leading digit and low byte.
+    // That tells every instruction apart but 00E0 / 00EE from other 0NNN
+    static constexpr auto decoded_ops = []{
+        std::array<uint8_t, 16 * 256> ops{};
+        for(int digit = 0; digit < 16; ++digit){
+            for(int NN = 0; NN < 256; ++NN){
+                ops[digit << 8 | NN] = digit == 0 ? OP_0NNN : decode_op(digit << 12 | NN);
             }
-            // trick to keep waiting while no keys are being pressed
-            PC -= 2;
+        }
+        return ops;
+    }();
+
+    events = 0;
+    int done = 0;
+    uint16_t opcode;
+
+    // ends every handler: leaves like run_loop() does, otherwise fetches
+    // the next instruction and jumps to its handler. Every handler gets its
+    // own copy of the indirect jump, so each one is predicted from the
+    // instruction that precedes it rather than from all of them
+#define DISPATCH() \
+    if(events || done == n){ \
+        return done; \
+    } \
+    log_state(); \
+    PC &= ADDR_MASK; \
+    opcode = ram[PC] << 8 | ram[(PC + 1) & ADDR_MASK]; \
+    LOGLN("Current instruction: 0x{:0X}", opcode); \
+    PROFILE(profile.count(PC, opcode)); \
+    PC += 2; \
+    ++done; \
+    goto *labels[decoded_ops[((opcode >> 4) & 0xF00) | (opcode & 0xFF)]]
+
+    DISPATCH();
+
+    op_none: DISPATCH();
+    // never jumped to, decoded_ops sends them to op_0NNN
+    op_00E0: execute<Q, OP_00E0>(*this, opcode); DISPATCH();
+    op_00EE: execute<Q, OP_00EE>(*this, opcode); DISPATCH();
+    op_0NNN: execute<Q, OP_0NNN>(*this, opcode); DISPATCH();
+    op_1NNN: execute<Q, OP_1NNN>(*this, opcode); DISPATCH();
+    op_2NNN: execute<Q, OP_2NNN>(*this, opcode); DISPATCH();
+    op_3XNN: execute<Q, OP_3XNN>(*this, opcode); DISPATCH();
+    op_4XNN: execute<Q, OP_4XNN>(*this, opcode); DISPATCH();
+    op_5XY0: execute<Q, OP_5XY0>(*this, opcode); DISPATCH();
+    op_6XNN: execute<Q, OP_6XNN>(*this, opcode); DISPATCH();
+    op_7XNN: execute<Q, OP_7XNN>(*this, opcode); DISPATCH();
+    op_8XY0: execute<Q, OP_8XY0>(*this, opcode); DISPATCH();
+    op_8XY1: execute<Q, OP_8XY1>(*this, opcode); DISPATCH();
+    op_8XY2: execute<Q, OP_8XY2>(*this, opcode); DISPATCH();
+    op_8XY3: execute<Q, OP_8XY3>(*this, opcode); DISPATCH();
+    op_8XY4: execute<Q, OP_8XY4>(*this, opcode); DISPATCH();
+    op_8XY5: execute<Q, OP_8XY5>(*this, opcode); DISPATCH();
+    op_8XY6: execute<Q, OP_8XY6>(*this, opcode); DISPATCH();
+    op_8XY7: execute<Q, OP_8XY7>(*this, opcode); DISPATCH();
+    op_8XYE: execute<Q, OP_8XYE>(*this, opcode); DISPATCH();
+    op_9XY0: execute<Q, OP_9XY0>(*this, opcode); DISPATCH();
+    op_ANNN: execute<Q, OP_ANNN>(*this, opcode); DISPATCH();
+    op_BNNN: execute<Q, OP_BNNN>(*this, opcode); DISPATCH();
+    op_CXNN: execute<Q, OP_CXNN>(*this, opcode); DISPATCH();
+    op_DXYN: execute<Q, OP_DXYN>(*this, opcode); DISPATCH();
+    op_EX9E: execute<Q, OP_EX9E>(*this, opcode); DISPATCH();
+    op_EXA1: execute<Q, OP_EXA1>(*this, opcode); DISPATCH();
+    op_FX07: execute<Q, OP_FX07>(*this, opcode); DISPATCH();
+    op_FX0A: execute<Q, OP_FX0A>(*this, opcode); DISPATCH();
+    op_FX15: execute<Q, OP_FX15>(*this, opcode); DISPATCH();
+    op_FX18: execute<Q, OP_FX18>(*this, opcode); DISPATCH();
+    op_FX1E: execute<Q, OP_FX1E>(*this, opcode); DISPATCH();
+    op_FX29: execute<Q, OP_FX29>(*this, opcode); DISPATCH();
+    op_FX33: execute<Q, OP_FX33>(*this, opcode); DISPATCH();
+    op_FX55: execute<Q, OP_FX55>(*this, opcode); DISPATCH();
+    op_FX65: execute<Q, OP_FX65>(*this, opcode); DISPATCH();
+
+#undef DISPATCH
+}
+#endif
+
+template<class Q>
+void Chip8::select_step(){
+    if(tracer){
+        step = &Chip8::step_traced<Q>;
+        run = &Chip8::run_loop<&Chip8::step_traced<Q>>;
+        return;
+    }
 
+    switch(backend){
+        case backend_t::interpreter:
+            step = &Chip8::step_interpreter<Q>;
+            run = &Chip8::run_loop<&Chip8::step_interpreter<Q>>;
         break;
-        // FX15, sets delay timer to V[X]
-        case 0x15:
-            delay_timer = V[instr.X];
-        break;
-        // FX18, sets sound timer to V[X]
-        case 0x18:
-            sound_timer = V[instr.X];
-        break;
-        // FX1E, add V[X] to I
-        case 0x1E:
-            I += V[instr.X];
-            // not std behavior but good to have
-            //V[0xF] = (I > 0xFFF);
+        case backend_t::predecoded:
+            step = &Chip8::step_predecoded<Q>;
+            run = &Chip8::run_loop<&Chip8::step_predecoded<Q>>;
         break;
-        // FX29, set I to the beginning of the system font char stored in VX
-        case 0x29:
-            // system font starts at ram[0]
-            I = ram[V[instr.X] & 0xF];
+        case backend_t::opcode_table:
+            step = &Chip8::step_table<Q>;
+            run = &Chip8::run_loop<&Chip8::step_table<Q>>;
         break;
-        // FX33, convert V[X] to decimal and store the result
-        // (always 3 digits) into ram[I], ram[I+1], ram[I+2]
-        case 0x33:
-            ram[I + 2] = V[instr.X] % 10;
-            ram[I + 1] = (V[instr.X] / 10) % 10;
-            ram[I] = (V[instr.X] / 100) % 10;
+        case backend_t::threaded:
+#ifdef CHIP8EMU_COMPUTED_GOTO
+            // single instructions gain nothing from threading
+            step = &Chip8::step_interpreter<Q>;
+            run = &Chip8::run_threaded<Q>;
+#endif
         break;
-        // FX55, store registers [V[0], V[X]] to [ram[I], ram[I + X]]
-        case 0x55:
-            for(int i = 0; i <= instr.X; ++i){
-                ram[I + i] = V[i];
-            }
-            if(FX55_FX65_modify_I){
-                I += instr.X + 1;
-            }
-        break;
-        // FX65, load registers [V[0], V[X]] from [ram[I], ram[I + X]]
-        case 0x65:
-            for(int i = 0; i <= instr.X; ++i){
-                V[i] = ram[I + i];
-            }
-            if(FX55_FX65_modify_I){
-                I += instr.X + 1;
-            }
+        case backend_t::jit_x64:
+            step = &Chip8::step_jit<Q>;
+            run = &Chip8::run_loop<&Chip8::step_jit<Q>>;
         break;
     }
 }
 
-void Chip8::cpu_next_instr(){
-    LOGLN(
-        "CHIP8 internal state:\n\tPC: 0x{:04X} -  "
-        "I: 0x{:04X}",
-        PC,
-        I
-    );
-    for(int i = 0; i < 16; i += 4){
-        LOG("\tV{:0X}: 0x{:02X} - ", i, V[i]);
-        LOG("V{:0X}: 0x{:02X} - ", i+1, V[i+1]);
-        LOG("V{:0X}: 0x{:02X} - ", i+2, V[i+2]);
-        LOGLN("V{:0X}: 0x{:02X}", i+3, V[i+3]);
+void Chip8::select_step(){
+    switch(quirks){
+        case quirks_t::cosmac_vip: select_step<quirks_cosmac_vip>(); break;
+        case quirks_t::schip: select_step<quirks_schip>(); break;
+        case quirks_t::modern: select_step<quirks_modern>(); break;
     }
+}
 
-    // Fetch
-    uint16_t tmp = ram[PC++] << 8;
-    tmp |= ram[PC++];
+int Chip8::cpu_next_instr(int max_instr){
+    return (this->*step)(max_instr);
+}
 
-    LOGLN("Current instruction: 0x{:0X}", tmp);
+int Chip8::run_cycles(int n){
+    return (this->*run)(n);
+}
 
-    // Decode
-    instruction_t instr(tmp);
-
-    // Execute
-    switch(tmp >> 12){
-        case 0x0: handle_0_instr(instr); break;
-        case 0x1: handle_1_instr(instr); break;
-        case 0x2: handle_2_instr(instr); break;
-        case 0x3: handle_3_instr(instr); break;
-        case 0x4: handle_4_instr(instr); break;
-        case 0x5: handle_5_instr(instr); break;
-        case 0x6: handle_6_instr(instr); break;
-        case 0x7: handle_7_instr(instr); break;
-        case 0x8: handle_8_instr(instr); break;
-        case 0x9: handle_9_instr(instr); break;
-        case 0xA: handle_A_instr(instr); break;
-        case 0xB: handle_B_instr(instr); break;
-        case 0xC: handle_C_instr(instr); break;
-        case 0xD: handle_D_instr(instr); break;
-        case 0xE: handle_E_instr(instr); break;
-        case 0xF: handle_F_instr(instr); break;
+int Chip8::run_frame(){
+    const int budget = get_cycles_per_frame();
+    uint8_t frame_events = 0;
+    int done = 0;
+
+    while(done < budget){
+        done += run_cycles(budget - done);
+        frame_events |= events;
+        // the rest of the frame would spin without changing anything
+        if(events & (EVENT_KEY_WAIT | EVENT_IDLE | EVENT_FAULT)){
+            skipped_cycles += budget - done;
+            done = budget;
+        }
     }
+
+    events = frame_events;
+    tick_timers();
+    return done;
 }
 
-const std::bitset<Chip8::SCREEN_SIZE>& Chip8::get_screen() const{
+int Chip8::get_cycles_per_frame() const{
+    return ips / refresh_rate;
+}
+
+uint64_t Chip8::get_skipped_cycles() const{
+    return skipped_cycles;
+}
+
+uint8_t Chip8::get_events() const{
+    return events;
+}
+
+Chip8::fault_t Chip8::get_fault() const{
+    return fault;
+}
+
+void Chip8::tick_timers(){
+    if(delay_timer > 0){
+        --delay_timer;
+    }
+    if(sound_timer > 0){
+        --sound_timer;
+    }
+}
+
+std::bitset<Chip8::SCREEN_SIZE> Chip8::get_screen() const{
+    std::bitset<SCREEN_SIZE> pixels;
+    for(int y = 0; y < SCREEN_HEIGHT; ++y){
+        for(uint64_t row = screen[y]; row; row &= row - 1){
+            const int x = 63 - std::countr_zero(row);
+            pixels.set(y * SCREEN_WIDTH + x);
+        }
+    }
+    return pixels;
+}
+
+const std::array<uint64_t, Chip8::SCREEN_HEIGHT>& Chip8::get_screen_rows() const{
     return screen;
 }
 
+uint64_t Chip8::get_screen_hash() const{
+    return hash_screen(screen);
+}
+
+uint64_t Chip8::hash_screen(const std::array<uint64_t, SCREEN_HEIGHT>& rows){
+    uint64_t h = 0xCBF29CE484222325;
+    for(uint64_t row : rows){
+        for(int i = 0; i < 8; ++i){
+            h ^= (row >> (8 * i)) & 0xFF;
+            h *= 0x100000001B3;
+        }
+    }
+    return h;
+}
+
+void Chip8::set_keyboard(uint16_t keys){
+    keyboard = keys;
+}
+
+uint64_t Chip8::get_draw_generation() const{
+    return draw_generation;
+}
+
+uint32_t Chip8::take_dirty_rows(){
+    return std::exchange(dirty_rows, 0);
+}
+
 uint8_t Chip8::get_delay_timer() const{
     return delay_timer;
 }
@@ -339,4 +548,10 @@ void Chip8::decrement_delay_timer(){
 
 void Chip8::decrement_sound_timer(){
     --sound_timer;
-}
\ No newline at end of file
+}
+
+#ifdef CHIP8EMU_PROFILE
+Profile& Chip8::get_profile(){
+    return profile;
+}
+#endif
\ No newline at end of file
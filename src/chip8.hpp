@@ -1,15 +1,25 @@
+#pragma once
+
 #include <array>
 #include <bitset>
-#include <stack>
 #include <cstddef>
 #include <cstdint>
 #include <cassert>
 #include <cstring>
 #include <utility>
-#include <random>
 #include <print>
 #include <chrono>
 #include <thread>
+#include <memory>
+#include <bit>
+#include <type_traits>
+#include <vector>
+
+#include "jit_x64.hpp"
+#include "opcodes.hpp"
+#include "prng.hpp"
+#include "profile.hpp"
+#include "tracer.hpp"
 
 //#define DEBUG
 
@@ -21,6 +31,18 @@
 #define LOGLN(...) ;
 #endif
 
+// defined by cmake -DCHIP8EMU_PROFILE=ON, see profile.hpp
+#ifdef CHIP8EMU_PROFILE
+#define PROFILE(...) __VA_ARGS__
+#else
+#define PROFILE(...) ;
+#endif
+
+// labels as values (GCC and Clang), needed by backend_t::threaded
+#ifdef __GNUC__
+#define CHIP8EMU_COMPUTED_GOTO
+#endif
+
 class Chip8{
     /*
         https://tobiasvl.github.io/blog/write-a-chip-8-emulator/
@@ -28,40 +50,74 @@ class Chip8{
         https://riv.dev/emulating-a-computer-part-4/
     */
 
-    // emulator config
-    // TODO set them in constructor and take them from CLI (GUI if it will exist)
-    bool copy_vy_to_vx_in_shift = false;
-    bool make_BNNN_into_BXNN = false;
-    bool FX55_FX65_modify_I = false;
-    int ips = 700; // instruction per second. 700 should be good
-    int refresh_rate = 60; // FPS
-
-    struct instruction_t{
-        uint32_t X: 4;
-        uint32_t Y: 4;
-        uint32_t N: 4;
-        uint32_t NN: 8;
-        // use NNN also to decode the instruction, see handle_x_instr()
-        uint32_t NNN: 12;
-
-        instruction_t(uint16_t n){
-            X = (n >> 8) & 0xF;
-            Y = (n >> 4) & 0xF;
-            N = n & 0xF;
-            NN = n & 0xFF;
-            NNN = n & 0xFFF;
-        };
+    // shares the quirk profiles and the memory image, see lockstep.hpp
+    friend class Lockstep;
+
+    public:
+    // quirk profiles, picked when loading a ROM
+    enum class quirks_t{
+        cosmac_vip, // original COSMAC VIP interpreter
+        schip, // SUPER-CHIP 1.1
+        modern // what most recent ROMs expect
     };
 
+    private:
+    // compile-time counterparts of quirks_t, the handlers that depend on
+    // a quirk are instantiated once per profile
+    struct quirks_cosmac_vip{
+        static constexpr bool copy_vy_to_vx_in_shift = true;
+        static constexpr bool make_BNNN_into_BXNN = false;
+        static constexpr bool FX55_FX65_modify_I = true;
+        static constexpr int stack_depth = 12;
+    };
+    struct quirks_schip{
+        static constexpr bool copy_vy_to_vx_in_shift = false;
+        static constexpr bool make_BNNN_into_BXNN = true;
+        static constexpr bool FX55_FX65_modify_I = false;
+        static constexpr int stack_depth = 16;
+    };
+    struct quirks_modern{
+        static constexpr bool copy_vy_to_vx_in_shift = false;
+        static constexpr bool make_BNNN_into_BXNN = false;
+        static constexpr bool FX55_FX65_modify_I = false;
+        static constexpr int stack_depth = 16;
+    };
+
+    // emulator config
+    // TODO take them from CLI (GUI if it will exist)
+    quirks_t quirks = quirks_t::modern;
+    static constexpr int DEFAULT_IPS = 700; // 700 should be good
+    static constexpr int DEFAULT_REFRESH_RATE = 60;
+    int ips = DEFAULT_IPS; // instruction per second
+    int refresh_rate = DEFAULT_REFRESH_RATE; // FPS
+
     static constexpr auto RAM_SIZE = 4096; // bytes
+    // addresses are 12 bits: PC and I wrap around the end of ram when used
+    static constexpr uint16_t ADDR_MASK = RAM_SIZE - 1;
     static constexpr auto MAX_PROG_SIZE = 4096 - 0x200; // bytes
     static constexpr auto GPREG_NUM = 16;
     static constexpr uint8_t FONT_START_ADDR = 0; // sys fonts stored here in ram
     static constexpr uint16_t PC_RESET_VALUE = 0x200;
-    static constexpr auto SCREEN_SIZE = 64 * 32; // 32 rows by 64 columns
+    public:
+    static constexpr auto SCREEN_WIDTH = 64;
+    static constexpr auto SCREEN_HEIGHT = 32;
+    static constexpr auto SCREEN_SIZE = SCREEN_WIDTH * SCREEN_HEIGHT;
+    static constexpr uint64_t DEFAULT_SEED = 0;
+    // deepest call stack of all the quirk profiles, see stack_depth
+    static constexpr auto MAX_STACK_DEPTH = 16;
+
+    // why the machine stopped, see EVENT_FAULT
+    enum class fault_t : uint8_t{
+        none,
+        stack_overflow, // 2NNN with every stack entry taken
+        stack_underflow // 00EE with an empty stack
+    };
+
+    private:
     static constexpr auto KEYBOARD_SIZE = 16; // keys go from '0' to 'F'
 
-    std::array<uint8_t, RAM_SIZE> ram{
+    // aligned so that copies of it (snapshots) run at full speed
+    alignas(64) std::array<uint8_t, RAM_SIZE> ram{
         0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
         0x20, 0x60, 0x20, 0x20, 0x70, // 1
         0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
@@ -80,40 +136,199 @@ class Chip8{
         0xF0, 0x80, 0xF0, 0x80, 0x80  // F
     };
     uint16_t PC = PC_RESET_VALUE;
-    uint16_t I;
-    std::array<uint8_t, GPREG_NUM> V;
-    std::stack<uint16_t> stack;
+    uint16_t I = 0;
+    std::array<uint8_t, GPREG_NUM> V{};
+    std::array<uint16_t, MAX_STACK_DEPTH> stack{}; // bottom first
+    uint8_t SP = 0; // entries taken in stack
     uint8_t delay_timer = 0;
     uint8_t sound_timer = 0;
 
-    std::bitset<SCREEN_SIZE> screen;
-    std::bitset<KEYBOARD_SIZE> keyboard;
-
-    void handle_0_instr(const instruction_t& instr);
-    void handle_1_instr(const instruction_t& instr);
-    void handle_2_instr(const instruction_t& instr);
-    void handle_3_instr(const instruction_t& instr);
-    void handle_4_instr(const instruction_t& instr);
-    void handle_5_instr(const instruction_t& instr);
-    void handle_6_instr(const instruction_t& instr);
-    void handle_7_instr(const instruction_t& instr);
-    void handle_8_instr(const instruction_t& instr);
-    void handle_9_instr(const instruction_t& instr);
-    void handle_A_instr(const instruction_t& instr);
-    void handle_B_instr(const instruction_t& instr);
-    void handle_C_instr(const instruction_t& instr);
-    void handle_D_instr(const instruction_t& instr);
-    void handle_E_instr(const instruction_t& instr);
-    void handle_F_instr(const instruction_t& instr);
+    // one word per row, column 0 is the most significant bit
+    std::array<uint64_t, SCREEN_HEIGHT> screen{};
+    // bumped by every 00E0 / DXYN
+    uint64_t draw_generation = 0;
+    // rows touched since the last take_dirty_rows(), one bit per row
+    uint32_t dirty_rows = ~0u;
+    // bit k set means key k is pressed
+    uint16_t keyboard = 0;
+    fault_t fault = fault_t::none;
+    // CXNN, same sequence for the same seed
+    Xoshiro128 rng{DEFAULT_SEED};
+#ifdef CHIP8EMU_PROFILE
+    Profile profile;
+#endif
+
+    public:
+    enum class backend_t{
+        interpreter,
+        predecoded,
+        // every handler jumps straight to the next one, see run_threaded()
+        threaded,
+        // one table lookup per instruction, see op_table()
+        opcode_table,
+        jit_x64
+    };
+
+    private:
+    // the host's choices and the backends' caches (with decoded below),
+    // not machine state: none of them is in state_t
+    backend_t backend = backend_t::interpreter;
+    std::unique_ptr<JitX64> jit;
+    Tracer* tracer = nullptr;
+
+    // runs OP on m, the operands are taken straight from the opcode. The
+    // only definition of what the instructions do: every backend but the JIT
+    // ends up here, and so does every lane of a Lockstep. m is this Chip8 or
+    // anything with the same members and hooks, see instructions.hpp
+    template<class Q, op_t OP, class M> static void execute(M& m, uint16_t opcode);
+    // execute() of decode_op(opcode)
+    template<class Q, class M> static void execute_opcode(M& m, uint16_t opcode);
+
+    using op_fn_t = void (*)(Chip8&, uint16_t);
+    template<class Q, op_t OP> static void execute_fn(Chip8& c, uint16_t opcode);
+    // execute_fn() of every opcode, indexed by the whole opcode and built
+    // at compile time, see step_table()
+    template<class Q> static const std::array<op_fn_t, 0x10000>& op_table();
+
+    // one entry per even address, fn == nullptr means not decoded yet
+    struct decoded_t{
+        op_fn_t fn = nullptr;
+        uint16_t opcode = 0;
+    };
+    std::array<decoded_t, RAM_SIZE / 2> decoded;
+
+    // cpu_next_instr() and run_cycles() for the current backend and quirks,
+    // see select_step()
+    int (Chip8::*step)(int max_instr) = &Chip8::step_interpreter<quirks_modern>;
+    int (Chip8::*run)(int n) = &Chip8::run_loop<&Chip8::step_interpreter<quirks_modern>>;
+    // EVENT_* raised since the beginning of the last run
+    uint8_t events = 0;
+    uint64_t skipped_cycles = 0;
+
+    // true when the 1NNN at jump_addr (PC already moved to NNN) spins until
+    // the next timer tick
+    static bool is_idle_loop(const std::array<uint8_t, RAM_SIZE>& ram, uint16_t PC, uint16_t jump_addr);
+
+    // FNV-1a, see get_screen_hash()
+    static uint64_t hash_screen(const std::array<uint64_t, SCREEN_HEIGHT>& rows);
+
+    void log_state() const;
+    template<class Q> int step_interpreter(int max_instr);
+    template<class Q> int step_predecoded(int max_instr);
+    template<class Q> int step_table(int max_instr);
+    template<class Q> int step_jit(int max_instr);
+    // step_interpreter() recording the instruction into tracer
+    template<class Q> int step_traced(int max_instr);
+    template<auto step_fn> int run_loop(int n);
+    // run_cycles() of backend_t::threaded, the whole loop is one function
+    template<class Q> int run_threaded(int n);
+    void select_step();
+    template<class Q> void select_step();
+
+    // to be called after every write to ram[addr, addr + len)
+    void invalidate_code(uint16_t addr, size_t len);
+    // stops at the instruction being executed, see EVENT_FAULT
+    void raise_fault(fault_t f);
+    // the other hooks of execute(): rows of the screen it changed, and what
+    // the profiler counts
+    void drew(uint32_t rows);
+    void count_skip();
+    void count_draw();
 
     public:
-    void cpu_next_instr();
-    void load(const std::vector<uint8_t>& prog);
-    const std::bitset<SCREEN_SIZE>& get_screen() const;
+    // everything that defines the machine, as one flat trivially copyable
+    // blob, see snapshot(). Chip8 itself isn't: it also owns what the
+    // backends derive from ram (decoded handlers, the JIT and its
+    // executable memory) and host-side settings (tracer, statistics). None
+    // of that changes what the machine does and all of it is rebuilt from
+    // ram, so machines are copied through state_t, not memcpy'd whole
+    struct alignas(64) state_t{
+        std::array<uint64_t, SCREEN_HEIGHT> screen;
+        std::array<uint8_t, RAM_SIZE> ram;
+        std::array<uint16_t, MAX_STACK_DEPTH> stack; // bottom first
+        uint8_t SP;
+        fault_t fault;
+        uint16_t PC;
+        uint16_t I;
+        uint16_t keyboard;
+        std::array<uint8_t, GPREG_NUM> V;
+        uint8_t delay_timer;
+        uint8_t sound_timer;
+        quirks_t quirks;
+        Xoshiro128::state_t rng;
+    };
+
+    // reasons for run_cycles() to return early
+    enum event_t : uint8_t{
+        EVENT_DRAW = 1 << 0, // 00E0 or DXYN
+        EVENT_SOUND = 1 << 1, // FX18 started the buzzer
+        EVENT_KEY_WAIT = 1 << 2, // FX0A is waiting for a key
+        EVENT_IDLE = 1 << 3, // spinning until the next timer tick, see is_idle_loop()
+        // the instruction at PC can't run, see get_fault(). PC stays on it,
+        // so the machine faults again every time it's run
+        EVENT_FAULT = 1 << 4
+    };
+
+    // returns false (and keeps the current backend) if the host can't run it
+    bool set_backend(backend_t b);
+    // records every instruction executed from now on into t, nullptr stops.
+    // While tracing, instructions run one by one on the interpreter
+    // whatever the backend. t must outlive the tracing
+    void set_tracer(Tracer* t);
+    // executes the next instruction, or with the JIT the next block if it
+    // fits in max_instr instructions. Returns the instructions executed
+    int cpu_next_instr(int max_instr = 1);
+    // executes up to n instructions, stopping after the first one that
+    // raises an event. Returns the instructions executed
+    int run_cycles(int n);
+    // executes one frame worth of instructions (ips / refresh_rate), then
+    // ticks the timers. On EVENT_KEY_WAIT or EVENT_IDLE the rest of the frame
+    // is skipped since nothing can change before the next tick or input, and
+    // so is it on EVENT_FAULT.
+    // Returns the instructions executed, skipped ones included
+    int run_frame();
+    // instructions run_frame() executes, ips / refresh_rate
+    int get_cycles_per_frame() const;
+    // instructions fast-forwarded by run_frame() so far
+    uint64_t get_skipped_cycles() const;
+    // EVENT_* raised by the last run_cycles() / run_frame()
+    uint8_t get_events() const;
+    // the last fault, fault_t::none if the machine never faulted
+    fault_t get_fault() const;
+    void tick_timers();
+    // returns false (and changes nothing) if prog doesn't fit in ram
+    bool load(const std::vector<uint8_t>& prog, quirks_t q = quirks_t::modern);
+    // restarts the CXNN random sequence. Instances are seeded with
+    // DEFAULT_SEED, so runs are reproducible unless seeded otherwise
+    void seed(uint64_t s);
+    // both are plain copies. restore() only drops the decoded /
+    // compiled code of the ram that actually changed, the backend and the
+    // statistics of this instance are kept
+    state_t snapshot() const;
+    void restore(const state_t& s);
+    // pixel (x, y) is bit y * SCREEN_WIDTH + x. Built on every call,
+    // prefer get_screen_rows()
+    std::bitset<SCREEN_SIZE> get_screen() const;
+    const std::array<uint64_t, SCREEN_HEIGHT>& get_screen_rows() const;
+    // FNV-1a of the screen rows, to compare runs without keeping screens around
+    uint64_t get_screen_hash() const;
+    // bit k set means key k is pressed
+    void set_keyboard(uint16_t keys);
+    // changes whenever the screen may have changed
+    uint64_t get_draw_generation() const;
+    // rows changed since the previous call (bit y for row y), all of them
+    // the first time. Frontends can skip rendering when it's 0
+    uint32_t take_dirty_rows();
     uint8_t get_delay_timer() const;
     uint8_t get_sound_timer() const;
     void decrement_delay_timer();
     void decrement_sound_timer();
+#ifdef CHIP8EMU_PROFILE
+    // counters since the instance was created or the last clear()
+    Profile& get_profile();
+#endif
 };
 
+static_assert(std::is_trivially_copyable_v<Chip8::state_t>);
+
 
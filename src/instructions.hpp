@@ -0,0 +1,251 @@
+#pragma once
+
+#include "chip8.hpp"
+
+// what the instructions do, for Chip8 and for the lanes of a Lockstep. M has
+// the registers, ram, screen, ... of a Chip8 under the same names, V only
+// needs operator[], and the hooks:
+//  raise_fault(f)            stops at the instruction, see EVENT_FAULT
+//  invalidate_code(a, len)   after every write to ram[a, a + len)
+//  drew(rows)                the rows of the screen that changed
+//  count_skip() count_draw() for the profiler
+
+template<class Q, op_t OP, class M>
+void Chip8::execute(M& m, uint16_t opcode){
+    [[maybe_unused]] const uint8_t X = opcode >> 8 & 0xF;
+    [[maybe_unused]] const uint8_t Y = opcode >> 4 & 0xF;
+    [[maybe_unused]] const uint8_t N = opcode & 0xF;
+    [[maybe_unused]] const uint8_t NN = opcode & 0xFF;
+    [[maybe_unused]] const uint16_t NNN = opcode & 0xFFF;
+    [[maybe_unused]] uint8_t tmp;
+
+    if constexpr(OP == OP_00E0){
+        m.screen.fill(0);
+        m.drew(~0u);
+        m.events |= EVENT_DRAW;
+    }
+    else if constexpr(OP == OP_00EE){
+        if(m.SP == 0){
+            m.raise_fault(fault_t::stack_underflow);
+            return;
+        }
+        m.PC = m.stack[--m.SP];
+    }
+    else if constexpr(OP == OP_0NNN){
+        // machine code routines aren't supported. run_threaded() sends
+        // 00E0 / 00EE here too
+        if(opcode == 0x00E0){
+            execute<Q, OP_00E0>(m, opcode);
+        }
+        else if(opcode == 0x00EE){
+            execute<Q, OP_00EE>(m, opcode);
+        }
+    }
+    else if constexpr(OP == OP_1NNN){
+        const uint16_t jump_addr = m.PC - 2;
+        m.PC = NNN;
+        if(is_idle_loop(m.ram, m.PC, jump_addr)){
+            m.events |= EVENT_IDLE;
+        }
+    }
+    else if constexpr(OP == OP_2NNN){
+        if(m.SP == Q::stack_depth){
+            m.raise_fault(fault_t::stack_overflow);
+            return;
+        }
+        m.stack[m.SP++] = m.PC;
+        m.PC = NNN;
+    }
+    else if constexpr(OP == OP_3XNN || OP == OP_4XNN || OP == OP_5XY0 || OP == OP_9XY0
+        || OP == OP_EX9E || OP == OP_EXA1){
+        bool skip;
+        if constexpr(OP == OP_3XNN){
+            skip = m.V[X] == NN;
+        }
+        else if constexpr(OP == OP_4XNN){
+            skip = m.V[X] != NN;
+        }
+        else if constexpr(OP == OP_5XY0){
+            skip = m.V[X] == m.V[Y];
+        }
+        else if constexpr(OP == OP_9XY0){
+            skip = m.V[X] != m.V[Y];
+        }
+        else if constexpr(OP == OP_EX9E){
+            skip = m.V[X] < KEYBOARD_SIZE && (m.keyboard >> m.V[X] & 1);
+        }
+        else{
+            skip = !(m.V[X] < KEYBOARD_SIZE && (m.keyboard >> m.V[X] & 1));
+        }
+        if(skip){
+            m.PC += 2;
+            m.count_skip();
+        }
+    }
+    else if constexpr(OP == OP_6XNN){
+        m.V[X] = NN;
+    }
+    else if constexpr(OP == OP_7XNN){
+        m.V[X] += NN;
+    }
+    else if constexpr(OP == OP_8XY0){
+        m.V[X] = m.V[Y];
+    }
+    else if constexpr(OP == OP_8XY1){
+        m.V[X] |= m.V[Y];
+    }
+    else if constexpr(OP == OP_8XY2){
+        m.V[X] &= m.V[Y];
+    }
+    else if constexpr(OP == OP_8XY3){
+        m.V[X] ^= m.V[Y];
+    }
+    else if constexpr(OP == OP_8XY4){
+        tmp = m.V[X];
+        m.V[X] += m.V[Y];
+        m.V[0xF] = (m.V[X] < tmp);
+    }
+    else if constexpr(OP == OP_8XY5){
+        tmp = m.V[X];
+        m.V[X] -= m.V[Y];
+        m.V[0xF] = !(m.V[X] > tmp);
+    }
+    else if constexpr(OP == OP_8XY6){
+        if constexpr(Q::copy_vy_to_vx_in_shift){
+            m.V[X] = m.V[Y];
+        }
+        tmp = m.V[X] & 0x1;
+        m.V[X] >>= 1;
+        m.V[0xF] = tmp;
+    }
+    else if constexpr(OP == OP_8XY7){
+        m.V[X] = m.V[Y] - m.V[X];
+        m.V[0xF] = !(m.V[X] > m.V[Y]);
+    }
+    else if constexpr(OP == OP_8XYE){
+        if constexpr(Q::copy_vy_to_vx_in_shift){
+            m.V[X] = m.V[Y];
+        }
+        tmp = m.V[X] >> 7;
+        m.V[X] <<= 1;
+        m.V[0xF] = tmp;
+    }
+    else if constexpr(OP == OP_ANNN){
+        m.I = NNN;
+    }
+    else if constexpr(OP == OP_BNNN){
+        m.PC = m.V[Q::make_BNNN_into_BXNN ? X : 0] + NNN;
+    }
+    else if constexpr(OP == OP_CXNN){
+        m.V[X] = (m.rng.next() >> 24) & NN;
+    }
+    else if constexpr(OP == OP_DXYN){
+        const uint8_t x = m.V[X] % 64; // col
+        const uint8_t y = m.V[Y] % 32; // row
+        m.V[0xF] = 0;
+        m.events |= EVENT_DRAW;
+        m.count_draw();
+
+        uint32_t rows = 0;
+        for(int r = 0; r < N && y + r < 32; ++r){
+            // sprite row moved to column x, whatever goes past column 63 is clipped
+            const uint64_t sprite_row = uint64_t(m.ram[(m.I + r) & ADDR_MASK]) << 56 >> x;
+
+            m.V[0xF] |= (m.screen[y + r] & sprite_row) != 0;
+            m.screen[y + r] ^= sprite_row;
+            rows |= uint32_t(sprite_row != 0) << (y + r);
+        }
+        m.drew(rows);
+    }
+    else if constexpr(OP == OP_FX07){
+        m.V[X] = m.delay_timer;
+    }
+    else if constexpr(OP == OP_FX0A){
+        if(m.keyboard){
+            m.V[X] = std::countr_zero(m.keyboard);
+            return;
+        }
+        m.PC -= 2;
+        m.events |= EVENT_KEY_WAIT;
+    }
+    else if constexpr(OP == OP_FX15){
+        m.delay_timer = m.V[X];
+    }
+    else if constexpr(OP == OP_FX18){
+        if(m.sound_timer == 0 && m.V[X] > 0){
+            m.events |= EVENT_SOUND;
+        }
+        m.sound_timer = m.V[X];
+    }
+    else if constexpr(OP == OP_FX1E){
+        m.I += m.V[X];
+    }
+    else if constexpr(OP == OP_FX29){
+        m.I = m.ram[m.V[X] & 0xF];
+    }
+    else if constexpr(OP == OP_FX33){
+        m.ram[(m.I + 2) & ADDR_MASK] = m.V[X] % 10;
+        m.ram[(m.I + 1) & ADDR_MASK] = (m.V[X] / 10) % 10;
+        m.ram[m.I & ADDR_MASK] = (m.V[X] / 100) % 10;
+        m.invalidate_code(m.I, 3);
+    }
+    else if constexpr(OP == OP_FX55){
+        for(int i = 0; i <= X; ++i){
+            m.ram[(m.I + i) & ADDR_MASK] = m.V[i];
+        }
+        m.invalidate_code(m.I, X + 1);
+        if constexpr(Q::FX55_FX65_modify_I){
+            m.I += X + 1;
+        }
+    }
+    else if constexpr(OP == OP_FX65){
+        for(int i = 0; i <= X; ++i){
+            m.V[i] = m.ram[(m.I + i) & ADDR_MASK];
+        }
+        if constexpr(Q::FX55_FX65_modify_I){
+            m.I += X + 1;
+        }
+    }
+}
+
+template<class Q, class M>
+void Chip8::execute_opcode(M& m, uint16_t opcode){
+    switch(decode_op(opcode)){
+        case OP_00E0: execute<Q, OP_00E0>(m, opcode); break;
+        case OP_00EE: execute<Q, OP_00EE>(m, opcode); break;
+        case OP_0NNN: execute<Q, OP_0NNN>(m, opcode); break;
+        case OP_1NNN: execute<Q, OP_1NNN>(m, opcode); break;
+        case OP_2NNN: execute<Q, OP_2NNN>(m, opcode); break;
+        case OP_3XNN: execute<Q, OP_3XNN>(m, opcode); break;
+        case OP_4XNN: execute<Q, OP_4XNN>(m, opcode); break;
+        case OP_5XY0: execute<Q, OP_5XY0>(m, opcode); break;
+        case OP_6XNN: execute<Q, OP_6XNN>(m, opcode); break;
+        case OP_7XNN: execute<Q, OP_7XNN>(m, opcode); break;
+        case OP_8XY0: execute<Q, OP_8XY0>(m, opcode); break;
+        case OP_8XY1: execute<Q, OP_8XY1>(m, opcode); break;
+        case OP_8XY2: execute<Q, OP_8XY2>(m, opcode); break;
+        case OP_8XY3: execute<Q, OP_8XY3>(m, opcode); break;
+        case OP_8XY4: execute<Q, OP_8XY4>(m, opcode); break;
+        case OP_8XY5: execute<Q, OP_8XY5>(m, opcode); break;
+        case OP_8XY6: execute<Q, OP_8XY6>(m, opcode); break;
+        case OP_8XY7: execute<Q, OP_8XY7>(m, opcode); break;
+        case OP_8XYE: execute<Q, OP_8XYE>(m, opcode); break;
+        case OP_9XY0: execute<Q, OP_9XY0>(m, opcode); break;
+        case OP_ANNN: execute<Q, OP_ANNN>(m, opcode); break;
+        case OP_BNNN: execute<Q, OP_BNNN>(m, opcode); break;
+        case OP_CXNN: execute<Q, OP_CXNN>(m, opcode); break;
+        case OP_DXYN: execute<Q, OP_DXYN>(m, opcode); break;
+        case OP_EX9E: execute<Q, OP_EX9E>(m, opcode); break;
+        case OP_EXA1: execute<Q, OP_EXA1>(m, opcode); break;
+        case OP_FX07: execute<Q, OP_FX07>(m, opcode); break;
+        case OP_FX0A: execute<Q, OP_FX0A>(m, opcode); break;
+        case OP_FX15: execute<Q, OP_FX15>(m, opcode); break;
+        case OP_FX18: execute<Q, OP_FX18>(m, opcode); break;
+        case OP_FX1E: execute<Q, OP_FX1E>(m, opcode); break;
+        case OP_FX29: execute<Q, OP_FX29>(m, opcode); break;
+        case OP_FX33: execute<Q, OP_FX33>(m, opcode); break;
+        case OP_FX55: execute<Q, OP_FX55>(m, opcode); break;
+        case OP_FX65: execute<Q, OP_FX65>(m, opcode); break;
+        case OP_NONE: case OPS: break;
+    }
+}
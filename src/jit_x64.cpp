@@ -0,0 +1,550 @@
+#include "jit_x64.hpp"
+
+#include <bit>
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define JIT_X64_SUPPORTED
+#endif
+
+namespace{
+
+// x86-64 register encoding
+enum reg_t : uint8_t{
+    RAX = 0, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11, R12, R13, R14, R15
+};
+
+// V registers are taken from this pool, I always lives in R11.
+// RAX and RCX are scratch, RDI/RSI/RDX hold the block arguments.
+constexpr std::array<uint8_t, 9> V_POOL{R8, R9, R10, RBX, RBP, R12, R13, R14, R15};
+constexpr uint8_t I_REG = R11;
+
+// 0F xx opcodes of setcc
+constexpr uint8_t SETC = 0x92;
+constexpr uint8_t SETNC = 0x93;
+// 0F xx opcodes of cmovcc
+constexpr uint8_t CMOVE = 0x44;
+constexpr uint8_t CMOVNE = 0x45;
+
+bool is_callee_saved(uint8_t r){
+    return r == RBX || r == RBP || r >= R12;
+}
+
+enum class kind_t{ unsupported, body, jump, skip };
+
+struct op_info_t{
+    kind_t kind = kind_t::unsupported;
+    uint16_t reads = 0; // V registers, one bit each
+    uint16_t writes = 0;
+    bool reads_I = false;
+    bool writes_I = false;
+};
+
+op_info_t classify(uint16_t op, uint16_t addr, bool shift_quirk){
+    const uint8_t X = (op >> 8) & 0xF;
+    const uint8_t Y = (op >> 4) & 0xF;
+    const uint8_t N = op & 0xF;
+    const uint8_t NN = op & 0xFF;
+    const uint16_t vx = 1 << X;
+    const uint16_t vy = 1 << Y;
+    const uint16_t vf = 1 << 0xF;
+
+    switch(op >> 12){
+        case 0x1:
+            // possible idle loops, the interpreter detects them
+            if((op & 0xFFF) == addr || (op & 0xFFF) + 4 == addr){
+                break;
+            }
+            return {kind_t::jump};
+        case 0x3:
+        case 0x4: return {kind_t::skip, vx};
+        case 0x5:
+        case 0x9:
+            if(N != 0){
+                break;
+            }
+            return {kind_t::skip, uint16_t(vx | vy)};
+        case 0x6: return {kind_t::body, 0, vx};
+        case 0x7: return {kind_t::body, vx, vx};
+        case 0x8:
+            // VF as an operand has corner cases, leave them to the interpreter
+            if(X == 0xF || Y == 0xF){
+                break;
+            }
+            switch(N){
+                case 0x0: return {kind_t::body, vy, vx};
+                case 0x1:
+                case 0x2:
+                case 0x3: return {kind_t::body, uint16_t(vx | vy), vx};
+                case 0x4:
+                case 0x5:
+                case 0x7: return {kind_t::body, uint16_t(vx | vy), uint16_t(vx | vf)};
+                case 0x6:
+                case 0xE: return {kind_t::body, uint16_t(shift_quirk ? vx | vy : vx), uint16_t(vx | vf)};
+            }
+        break;
+        case 0xA: return {kind_t::body, 0, 0, false, true};
+        case 0xF:
+            switch(NN){
+                case 0x07: return {kind_t::body, 0, vx};
+                case 0x15: return {kind_t::body, vx};
+                case 0x1E: return {kind_t::body, vx, 0, true, true};
+            }
+        break;
+    }
+
+    return {};
+}
+
+class emitter_t{
+    uint8_t* p;
+
+    void rex(uint8_t reg, uint8_t rm){
+        // always emitted so that SPL/BPL/SIL/DIL are reachable as byte registers
+        byte(0x40 | ((reg >> 3) << 2) | (rm >> 3));
+    }
+
+    void modrm(uint8_t mod, uint8_t reg, uint8_t rm){
+        byte((mod << 6) | ((reg & 7) << 3) | (rm & 7));
+    }
+
+    public:
+    explicit emitter_t(uint8_t* p): p(p){}
+
+    uint8_t* pos() const{
+        return p;
+    }
+
+    void byte(uint8_t b){
+        *p++ = b;
+    }
+
+    void imm16(uint16_t v){
+        byte(v & 0xFF);
+        byte(v >> 8);
+    }
+
+    void imm32(uint32_t v){
+        imm16(v & 0xFFFF);
+        imm16(v >> 16);
+    }
+
+    // <op> dst8, src8 using the "r/m8, r8" form (mov, add, or, and, sub, xor, cmp)
+    void op_rr8(uint8_t opcode, uint8_t dst, uint8_t src){
+        rex(src, dst);
+        byte(opcode);
+        modrm(3, src, dst);
+    }
+
+    void mov_r8_imm(uint8_t dst, uint8_t imm){
+        rex(0, dst);
+        byte(0xB0 + (dst & 7));
+        byte(imm);
+    }
+
+    // group 1 (80 /ext ib): 0 = add, 7 = cmp
+    void grp1_r8_imm(uint8_t ext, uint8_t dst, uint8_t imm){
+        rex(0, dst);
+        byte(0x80);
+        modrm(3, ext, dst);
+        byte(imm);
+    }
+
+    // group 2 by one (D0 /ext): 4 = shl, 5 = shr
+    void grp2_r8_1(uint8_t ext, uint8_t dst){
+        rex(0, dst);
+        byte(0xD0);
+        modrm(3, ext, dst);
+    }
+
+    void setcc(uint8_t cc, uint8_t dst){
+        rex(0, dst);
+        byte(0x0F);
+        byte(cc);
+        modrm(3, 0, dst);
+    }
+
+    // mov dst8, [base + disp]
+    void load_r8(uint8_t dst, uint8_t base, uint8_t disp){
+        rex(dst, base);
+        byte(0x8A);
+        modrm(1, dst, base);
+        byte(disp);
+    }
+
+    // mov [base + disp], src8
+    void store_r8(uint8_t base, uint8_t disp, uint8_t src){
+        rex(src, base);
+        byte(0x88);
+        modrm(1, src, base);
+        byte(disp);
+    }
+
+    // movzx dst32, src8
+    void movzx_r32_r8(uint8_t dst, uint8_t src){
+        rex(dst, src);
+        byte(0x0F);
+        byte(0xB6);
+        modrm(3, dst, src);
+    }
+
+    // movzx dst32, word [base]
+    void load_r16(uint8_t dst, uint8_t base){
+        rex(dst, base);
+        byte(0x0F);
+        byte(0xB7);
+        modrm(1, dst, base);
+        byte(0);
+    }
+
+    // mov word [base], src16
+    void store_r16(uint8_t base, uint8_t src){
+        byte(0x66);
+        rex(src, base);
+        byte(0x89);
+        modrm(1, src, base);
+        byte(0);
+    }
+
+    void mov_r16_imm(uint8_t dst, uint16_t imm){
+        byte(0x66);
+        rex(0, dst);
+        byte(0xB8 + (dst & 7));
+        imm16(imm);
+    }
+
+    // add dst16, src16
+    void add_r16(uint8_t dst, uint8_t src){
+        byte(0x66);
+        rex(src, dst);
+        byte(0x01);
+        modrm(3, src, dst);
+    }
+
+    void mov_r32_imm(uint8_t dst, uint32_t imm){
+        rex(0, dst);
+        byte(0xB8 + (dst & 7));
+        imm32(imm);
+    }
+
+    void cmovcc_r32(uint8_t cc, uint8_t dst, uint8_t src){
+        rex(dst, src);
+        byte(0x0F);
+        byte(cc);
+        modrm(3, dst, src);
+    }
+
+    void push(uint8_t r){
+        rex(0, r);
+        byte(0x50 + (r & 7));
+    }
+
+    void pop(uint8_t r){
+        rex(0, r);
+        byte(0x58 + (r & 7));
+    }
+
+    void ret(){
+        byte(0xC3);
+    }
+};
+
+}
+
+#ifdef JIT_X64_SUPPORTED
+namespace{
+
+// W^X: the pages of [from, from + len) are either writable or executable
+bool set_writable(uint8_t* from, size_t len, bool writable){
+    const uintptr_t page = sysconf(_SC_PAGESIZE);
+    const uintptr_t begin = uintptr_t(from) & ~(page - 1);
+    const uintptr_t end = (uintptr_t(from) + len + page - 1) & ~(page - 1);
+    const int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC;
+    return mprotect(reinterpret_cast<void*>(begin), end - begin, prot) == 0;
+}
+
+}
+#endif
+
+JitX64::JitX64(){
+#ifdef JIT_X64_SUPPORTED
+    void* mem = mmap(
+        nullptr, CODE_BUFFER_SIZE,
+        PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS,
+        -1, 0
+    );
+    if(mem == MAP_FAILED){
+        return;
+    }
+    // some hosts never let anonymous memory become executable
+    if(!set_writable(static_cast<uint8_t*>(mem), CODE_BUFFER_SIZE, false)){
+        munmap(mem, CODE_BUFFER_SIZE);
+        return;
+    }
+    code_buffer = static_cast<uint8_t*>(mem);
+#endif
+}
+
+JitX64::~JitX64(){
+#ifdef JIT_X64_SUPPORTED
+    if(code_buffer){
+        munmap(code_buffer, CODE_BUFFER_SIZE);
+    }
+#endif
+}
+
+bool JitX64::available() const{
+    return code_buffer != nullptr;
+}
+
+void JitX64::flush(){
+    blocks.fill({});
+    code_bytes.reset();
+    code_size = 0;
+}
+
+void JitX64::invalidate(uint16_t addr, size_t len){
+    for(size_t i = addr; i < addr + len && i < RAM_SIZE; ++i){
+        if(code_bytes.test(i)){
+            // blocks don't know who overlaps them, start over
+            flush();
+            return;
+        }
+    }
+}
+
+const JitX64::block_t& JitX64::get_block(const uint8_t* ram, uint16_t pc, bool copy_vy_to_vx_in_shift){
+    if(shift_quirk != copy_vy_to_vx_in_shift){
+        flush();
+        shift_quirk = copy_vy_to_vx_in_shift;
+    }
+
+    // a block has to fit in ram, the interpreter deals with the rest
+    static constexpr block_t NO_BLOCK{nullptr, 0, true};
+    if(pc + 1 >= RAM_SIZE){
+        return NO_BLOCK;
+    }
+
+    if(!blocks[pc].compiled){
+        if(CODE_BUFFER_SIZE - code_size < MAX_BLOCK_BYTES){
+            flush();
+        }
+        blocks[pc] = compile(ram, pc);
+    }
+
+    return blocks[pc];
+}
+
+JitX64::block_t JitX64::compile(const uint8_t* ram, uint16_t pc){
+    block_t block;
+    block.compiled = true;
+
+    if(!available()){
+        return block;
+    }
+
+    // first pass: pick the instructions and the registers they need
+    std::array<uint16_t, MAX_BLOCK_LEN> body;
+    int body_len = 0;
+    uint16_t term = 0;
+    op_info_t term_info;
+    uint16_t reads = 0;
+    uint16_t writes = 0;
+    bool reads_I = false;
+    bool writes_I = false;
+
+    uint16_t addr = pc;
+    while(body_len < MAX_BLOCK_LEN && addr + 1 < RAM_SIZE){
+        const uint16_t op = ram[addr] << 8 | ram[addr + 1];
+        const op_info_t info = classify(op, addr, shift_quirk);
+
+        if(info.kind == kind_t::unsupported){
+            break;
+        }
+        if(std::popcount(uint16_t(reads | writes | info.reads | info.writes)) > int(V_POOL.size())){
+            break;
+        }
+
+        reads |= info.reads;
+        writes |= info.writes;
+        reads_I |= info.reads_I;
+        writes_I |= info.writes_I;
+
+        if(info.kind != kind_t::body){
+            term = op;
+            term_info = info;
+            break;
+        }
+
+        body[body_len++] = op;
+        addr += 2;
+    }
+
+    const bool has_term = term_info.kind != kind_t::unsupported;
+    if(body_len == 0 && !has_term){
+        return block;
+    }
+
+    // second pass: emit
+    const uint16_t used = reads | writes;
+    std::array<uint8_t, 16> host{};
+    int used_count = 0;
+    for(int v = 0; v < 16; ++v){
+        if(used & (1 << v)){
+            host[v] = V_POOL[used_count++];
+        }
+    }
+
+    uint8_t* start = code_buffer + code_size;
+#ifdef JIT_X64_SUPPORTED
+    if(!set_writable(start, MAX_BLOCK_BYTES, true)){
+        return block;
+    }
+#endif
+    emitter_t e(start);
+
+    for(int k = 0; k < used_count; ++k){
+        if(is_callee_saved(V_POOL[k])){
+            e.push(V_POOL[k]);
+        }
+    }
+    for(int v = 0; v < 16; ++v){
+        // every write is unconditional, write-only registers need no load
+        if(reads & (1 << v)){
+            e.load_r8(host[v], RDI, v);
+        }
+    }
+    if(reads_I){
+        e.load_r16(I_REG, RSI);
+    }
+
+    for(int k = 0; k < body_len; ++k){
+        const uint16_t op = body[k];
+        const uint8_t X = (op >> 8) & 0xF;
+        const uint8_t Y = (op >> 4) & 0xF;
+        const uint8_t NN = op & 0xFF;
+        const uint8_t hx = host[X];
+        const uint8_t hy = host[Y];
+        const uint8_t hf = host[0xF];
+
+        switch(op >> 12){
+            case 0x6: e.mov_r8_imm(hx, NN); break;
+            case 0x7: e.grp1_r8_imm(0, hx, NN); break;
+            case 0x8:
+                switch(op & 0xF){
+                    case 0x0: e.op_rr8(0x88, hx, hy); break;
+                    case 0x1: e.op_rr8(0x08, hx, hy); break;
+                    case 0x2: e.op_rr8(0x20, hx, hy); break;
+                    case 0x3: e.op_rr8(0x30, hx, hy); break;
+                    case 0x4:
+                        e.op_rr8(0x00, hx, hy);
+                        e.setcc(SETC, hf);
+                    break;
+                    case 0x5:
+                        e.op_rr8(0x28, hx, hy);
+                        e.setcc(SETNC, hf);
+                    break;
+                    case 0x7:
+                        e.op_rr8(0x88, RAX, hy);
+                        e.op_rr8(0x28, RAX, hx);
+                        e.setcc(SETNC, hf);
+                        e.op_rr8(0x88, hx, RAX);
+                    break;
+                    case 0x6:
+                        if(shift_quirk){
+                            e.op_rr8(0x88, hx, hy);
+                        }
+                        e.grp2_r8_1(5, hx);
+                        e.setcc(SETC, hf);
+                    break;
+                    case 0xE:
+                        if(shift_quirk){
+                            e.op_rr8(0x88, hx, hy);
+                        }
+                        e.grp2_r8_1(4, hx);
+                        e.setcc(SETC, hf);
+                    break;
+                }
+            break;
+            case 0xA: e.mov_r16_imm(I_REG, op & 0xFFF); break;
+            case 0xF:
+                switch(NN){
+                    case 0x07: e.load_r8(hx, RDX, 0); break;
+                    case 0x15: e.store_r8(RDX, 0, hx); break;
+                    case 0x1E:
+                        e.movzx_r32_r8(RAX, hx);
+                        e.add_r16(I_REG, RAX);
+                    break;
+                }
+            break;
+        }
+    }
+
+    for(int v = 0; v < 16; ++v){
+        if(writes & (1 << v)){
+            e.store_r8(RDI, v, host[v]);
+        }
+    }
+    if(writes_I){
+        e.store_r16(RSI, I_REG);
+    }
+
+    const uint8_t tx = host[(term >> 8) & 0xF];
+    const uint8_t ty = host[(term >> 4) & 0xF];
+    switch(term_info.kind){
+        case kind_t::jump:
+            e.mov_r32_imm(RAX, term & 0xFFF);
+        break;
+        case kind_t::skip:
+            e.mov_r32_imm(RAX, addr + 2);
+            e.mov_r32_imm(RCX, addr + 4);
+            switch(term >> 12){
+                case 0x3:
+                    e.grp1_r8_imm(7, tx, term & 0xFF);
+                    e.cmovcc_r32(CMOVE, RAX, RCX);
+                break;
+                case 0x4:
+                    e.grp1_r8_imm(7, tx, term & 0xFF);
+                    e.cmovcc_r32(CMOVNE, RAX, RCX);
+                break;
+                case 0x5:
+                    e.op_rr8(0x38, tx, ty);
+                    e.cmovcc_r32(CMOVE, RAX, RCX);
+                break;
+                case 0x9:
+                    e.op_rr8(0x38, tx, ty);
+                    e.cmovcc_r32(CMOVNE, RAX, RCX);
+                break;
+            }
+        break;
+        default:
+            // fall through to the instruction the block stopped at
+            e.mov_r32_imm(RAX, addr);
+        break;
+    }
+
+    for(int k = used_count - 1; k >= 0; --k){
+        if(is_callee_saved(V_POOL[k])){
+            e.pop(V_POOL[k]);
+        }
+    }
+    e.ret();
+
+#ifdef JIT_X64_SUPPORTED
+    if(!set_writable(start, MAX_BLOCK_BYTES, false)){
+        return block;
+    }
+#endif
+    code_size += e.pos() - start;
+    const uint16_t end = has_term ? addr + 2 : addr;
+    for(uint16_t i = pc; i < end; ++i){
+        code_bytes.set(i);
+    }
+
+    block.code = reinterpret_cast<block_fn_t>(start);
+    block.len = body_len + has_term;
+    return block;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+
+class JitX64{
+    /*
+        Dynamic recompiler for x86-64 hosts (System V ABI).
+
+        A block starts at a given PC and covers the straight-line run of
+        instructions that only touch V, I and the delay timer, optionally
+        closed by a jump or a conditional skip. The V registers used by
+        the block and I live in host registers for the whole block, so
+        memory is only touched in the prologue and the epilogue.
+        Everything else (draw, call/ret, keys, ram access, ...) ends the
+        block and is left to the interpreter.
+    */
+
+    public:
+    // returns the PC of the next instruction to execute
+    using block_fn_t = uint16_t (*)(uint8_t* V, uint16_t* I, uint8_t* delay_timer);
+
+    struct block_t{
+        block_fn_t code = nullptr; // nullptr: let the interpreter run PC
+        uint8_t len = 0; // chip8 instructions executed by the block
+        bool compiled = false;
+    };
+
+    JitX64();
+    ~JitX64();
+    JitX64(const JitX64&) = delete;
+    JitX64& operator=(const JitX64&) = delete;
+
+    // false when the host can't run generated code
+    bool available() const;
+    const block_t& get_block(const uint8_t* ram, uint16_t pc, bool copy_vy_to_vx_in_shift);
+    // must be called whenever ram[addr, addr + len) is written
+    void invalidate(uint16_t addr, size_t len);
+    void flush();
+
+    private:
+    static constexpr auto RAM_SIZE = 4096;
+    static constexpr auto CODE_BUFFER_SIZE = 1 << 20;
+    static constexpr auto MAX_BLOCK_LEN = 32;
+    // worst case size of a single block, see compile()
+    static constexpr auto MAX_BLOCK_BYTES = 1024;
+
+    uint8_t* code_buffer = nullptr;
+    size_t code_size = 0;
+    bool shift_quirk = false;
+
+    std::array<block_t, RAM_SIZE> blocks;
+    // ram bytes covered by at least one compiled block
+    std::bitset<RAM_SIZE> code_bytes;
+
+    block_t compile(const uint8_t* ram, uint16_t pc);
+};
@@ -0,0 +1,541 @@
+#include "lockstep.hpp"
+#include "instructions.hpp"
+
+#include <algorithm>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace{
+
+// byte-wise operations on VEC_LANES lanes at once. Comparisons return
+// 0xFF for true and 0x00 for false in each lane
+#if defined(__AVX2__)
+using vec_t = __m256i;
+constexpr size_t VEC_LANES = 32;
+
+vec_t load_lanes(const uint8_t* p){ return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+void store_lanes(uint8_t* p, vec_t v){ _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+vec_t splat(uint8_t b){ return _mm256_set1_epi8(b); }
+vec_t add(vec_t a, vec_t b){ return _mm256_add_epi8(a, b); }
+vec_t adds(vec_t a, vec_t b){ return _mm256_adds_epu8(a, b); }
+vec_t sub(vec_t a, vec_t b){ return _mm256_sub_epi8(a, b); }
+vec_t subs(vec_t a, vec_t b){ return _mm256_subs_epu8(a, b); }
+vec_t and_(vec_t a, vec_t b){ return _mm256_and_si256(a, b); }
+vec_t or_(vec_t a, vec_t b){ return _mm256_or_si256(a, b); }
+vec_t xor_(vec_t a, vec_t b){ return _mm256_xor_si256(a, b); }
+vec_t eq(vec_t a, vec_t b){ return _mm256_cmpeq_epi8(a, b); }
+vec_t ge(vec_t a, vec_t b){ return _mm256_cmpeq_epi8(_mm256_max_epu8(a, b), a); }
+// no 8 bit shifts, shift 16 bit words and drop what crossed a byte
+vec_t shr1(vec_t a){ return _mm256_and_si256(_mm256_srli_epi16(a, 1), splat(0x7F)); }
+vec_t msb(vec_t a){ return _mm256_and_si256(_mm256_srli_epi16(a, 7), splat(0x01)); }
+uint64_t mask(vec_t m){ return uint32_t(_mm256_movemask_epi8(m)); }
+
+// I[l] += V[l] for 16 lanes
+void add_widen(uint16_t* dst, const uint8_t* src){
+    const __m256i wide = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src)));
+    __m256i* d = reinterpret_cast<__m256i*>(dst);
+    _mm256_storeu_si256(d, _mm256_add_epi16(_mm256_loadu_si256(d), wide));
+}
+constexpr size_t WIDE_LANES = 16;
+#elif defined(__SSE2__)
+using vec_t = __m128i;
+constexpr size_t VEC_LANES = 16;
+
+vec_t load_lanes(const uint8_t* p){ return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+void store_lanes(uint8_t* p, vec_t v){ _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v); }
+vec_t splat(uint8_t b){ return _mm_set1_epi8(b); }
+vec_t add(vec_t a, vec_t b){ return _mm_add_epi8(a, b); }
+vec_t adds(vec_t a, vec_t b){ return _mm_adds_epu8(a, b); }
+vec_t sub(vec_t a, vec_t b){ return _mm_sub_epi8(a, b); }
+vec_t subs(vec_t a, vec_t b){ return _mm_subs_epu8(a, b); }
+vec_t and_(vec_t a, vec_t b){ return _mm_and_si128(a, b); }
+vec_t or_(vec_t a, vec_t b){ return _mm_or_si128(a, b); }
+vec_t xor_(vec_t a, vec_t b){ return _mm_xor_si128(a, b); }
+vec_t eq(vec_t a, vec_t b){ return _mm_cmpeq_epi8(a, b); }
+vec_t ge(vec_t a, vec_t b){ return _mm_cmpeq_epi8(_mm_max_epu8(a, b), a); }
+vec_t shr1(vec_t a){ return _mm_and_si128(_mm_srli_epi16(a, 1), splat(0x7F)); }
+vec_t msb(vec_t a){ return _mm_and_si128(_mm_srli_epi16(a, 7), splat(0x01)); }
+uint64_t mask(vec_t m){ return uint32_t(_mm_movemask_epi8(m)); }
+
+// I[l] += V[l] for 8 lanes
+void add_widen(uint16_t* dst, const uint8_t* src){
+    const __m128i wide = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src)), _mm_setzero_si128());
+    __m128i* d = reinterpret_cast<__m128i*>(dst);
+    _mm_storeu_si128(d, _mm_add_epi16(_mm_loadu_si128(d), wide));
+}
+constexpr size_t WIDE_LANES = 8;
+#else
+using vec_t = uint8_t;
+constexpr size_t VEC_LANES = 1;
+
+vec_t load_lanes(const uint8_t* p){ return *p; }
+void store_lanes(uint8_t* p, vec_t v){ *p = v; }
+vec_t splat(uint8_t b){ return b; }
+vec_t add(vec_t a, vec_t b){ return a + b; }
+vec_t adds(vec_t a, vec_t b){ return std::min(a + b, 0xFF); }
+vec_t sub(vec_t a, vec_t b){ return a - b; }
+vec_t subs(vec_t a, vec_t b){ return a > b ? a - b : 0; }
+vec_t and_(vec_t a, vec_t b){ return a & b; }
+vec_t or_(vec_t a, vec_t b){ return a | b; }
+vec_t xor_(vec_t a, vec_t b){ return a ^ b; }
+vec_t eq(vec_t a, vec_t b){ return a == b ? 0xFF : 0x00; }
+vec_t ge(vec_t a, vec_t b){ return a >= b ? 0xFF : 0x00; }
+vec_t shr1(vec_t a){ return a >> 1; }
+vec_t msb(vec_t a){ return a >> 7; }
+uint64_t mask(vec_t m){ return m >> 7; }
+
+void add_widen(uint16_t* dst, const uint8_t* src){
+    *dst += *src;
+}
+constexpr size_t WIDE_LANES = 1;
+#endif
+
+vec_t not_(vec_t a){ return xor_(a, splat(0xFF)); }
+vec_t one(vec_t m){ return and_(m, splat(0x01)); }
+
+}
+
+Lockstep::Lockstep(size_t lanes) :
+    lanes(lanes),
+    padded_lanes((lanes + LANE_PADDING - 1) / LANE_PADDING * LANE_PADDING),
+    V(GPREG_NUM * padded_lanes),
+    I(padded_lanes),
+    delay_timer(padded_lanes),
+    sound_timer(padded_lanes),
+    keyboard(lanes),
+    PC(lanes, Chip8::PC_RESET_VALUE),
+    stack(lanes),
+    SP(lanes),
+    fault(lanes),
+    ram(lanes, Chip8().ram),
+    screen(lanes),
+    skip(padded_lanes),
+    rng(lanes, Xoshiro128(Chip8::DEFAULT_SEED))
+{
+    assert(lanes > 0);
+    uniform.set();
+}
+
+void Lockstep::load(const std::vector<uint8_t>& prog, Chip8::quirks_t q){
+    // same memory image as a freshly loaded Chip8
+    Chip8 image;
+    image.load(prog, q);
+    std::fill(ram.begin(), ram.end(), image.ram);
+    uniform.set();
+    written.reset();
+
+    // and every lane restarts
+    quirks = q;
+    std::ranges::fill(V, 0);
+    std::ranges::fill(I, 0);
+    std::ranges::fill(delay_timer, 0);
+    std::ranges::fill(sound_timer, 0);
+    std::ranges::fill(PC, Chip8::PC_RESET_VALUE);
+    std::ranges::fill(SP, 0);
+    std::ranges::fill(fault, Chip8::fault_t::none);
+    std::ranges::fill(screen, std::array<uint64_t, Chip8::SCREEN_HEIGHT>{});
+    converged = true;
+    shared_PC = Chip8::PC_RESET_VALUE;
+}
+
+void Lockstep::set_keyboard(size_t lane, uint16_t keys){
+    keyboard[lane] = keys;
+}
+
+void Lockstep::seed(size_t lane, uint64_t s){
+    rng[lane].seed(s);
+}
+
+uint8_t* Lockstep::reg(int x){
+    return &V[x * padded_lanes];
+}
+
+// one lane, under the names Chip8::execute() expects
+struct Lockstep::lane_t{
+    // V[x] of the lane, padded_lanes apart
+    struct strided_t{
+        uint8_t* first;
+        size_t stride;
+        uint8_t& operator[](size_t x) const{ return first[x * stride]; }
+    } V;
+    uint16_t& PC;
+    uint16_t& I;
+    uint8_t& delay_timer;
+    uint8_t& sound_timer;
+    uint16_t keyboard;
+    std::array<uint16_t, Chip8::MAX_STACK_DEPTH>& stack;
+    uint8_t& SP;
+    Chip8::fault_t& fault;
+    std::array<uint8_t, RAM_SIZE>& ram;
+    std::array<uint64_t, Chip8::SCREEN_HEIGHT>& screen;
+    Xoshiro128& rng;
+    std::bitset<RAM_SIZE>& uniform;
+    std::bitset<RAM_SIZE>& written;
+    uint8_t events = 0;
+
+    void raise_fault(Chip8::fault_t f){
+        PC -= 2;
+        fault = f;
+        events |= Chip8::EVENT_FAULT;
+    }
+    void invalidate_code(uint16_t addr, size_t len){
+        for(size_t a = addr; a < addr + len; ++a){
+            uniform.reset(a & Chip8::ADDR_MASK);
+            written.set(a & Chip8::ADDR_MASK);
+        }
+    }
+    // nothing tracks the lanes' screens or profiles them
+    void drew(uint32_t){}
+    void count_skip(){}
+    void count_draw(){}
+};
+
+Lockstep::lane_t Lockstep::get_lane(size_t lane){
+    return {
+        .V = {&V[lane], padded_lanes},
+        .PC = PC[lane],
+        .I = I[lane],
+        .delay_timer = delay_timer[lane],
+        .sound_timer = sound_timer[lane],
+        .keyboard = keyboard[lane],
+        .stack = stack[lane],
+        .SP = SP[lane],
+        .fault = fault[lane],
+        .ram = ram[lane],
+        .screen = screen[lane],
+        .rng = rng[lane],
+        .uniform = uniform,
+        .written = written,
+    };
+}
+
+template<class Q>
+bool Lockstep::execute(lane_t& m, uint16_t op){
+    m.events = 0;
+    Chip8::execute_opcode<Q>(m, op);
+    return m.events & (Chip8::EVENT_KEY_WAIT | Chip8::EVENT_IDLE | Chip8::EVENT_FAULT);
+}
+
+template<class Q>
+void Lockstep::run_lane(size_t lane, int n){
+    lane_t m = get_lane(lane);
+    for(int done = 0; done < n; ++done){
+        m.PC &= Chip8::ADDR_MASK;
+        const uint16_t op = m.ram[m.PC] << 8 | m.ram[(m.PC + 1) & Chip8::ADDR_MASK];
+        m.PC += 2;
+        ++scalar_steps;
+        if(execute<Q>(m, op)){
+            return;
+        }
+    }
+}
+
+template<class Q>
+bool Lockstep::step_each_lane(uint16_t op, bool may_branch){
+    std::fill_n(PC.begin(), lanes, shared_PC);
+    bool parked = true;
+    for(size_t l = 0; l < lanes; ++l){
+        lane_t m = get_lane(l);
+        parked &= execute<Q>(m, op);
+    }
+    scalar_steps += lanes;
+
+    if(written.any()){
+        refresh_uniform();
+    }
+    if(may_branch){
+        try_converge();
+    }
+    return parked;
+}
+
+template<class Q>
+bool Lockstep::step_converged(){
+    const uint16_t pc = shared_PC;
+    const uint16_t op = ram[0][pc] << 8 | ram[0][pc + 1];
+    shared_PC += 2;
+
+    const int X = (op >> 8) & 0xF;
+    const int Y = (op >> 4) & 0xF;
+    const uint8_t NN = op & 0xFF;
+    const uint16_t NNN = op & 0xFFF;
+    uint8_t* vx = reg(X);
+    uint8_t* vy = reg(Y);
+    uint8_t* vf = reg(0xF);
+
+    // per lane condition of a skip, lanes that don't agree diverge
+    auto skip_if = [&](auto cond){
+        const uint64_t full = (uint64_t(1) << VEC_LANES) - 1;
+        bool any = false;
+        bool all = true;
+        for(size_t l = 0; l < lanes; l += VEC_LANES){
+            const vec_t c = cond(l);
+            store_lanes(&skip[l], one(c));
+            const uint64_t valid = lanes - l >= VEC_LANES ? full : (uint64_t(1) << (lanes - l)) - 1;
+            const uint64_t m = mask(c) & valid;
+            any |= m != 0;
+            all &= m == valid;
+        }
+        if(all){
+            shared_PC += 2;
+        }
+        else if(any){
+            for(size_t l = 0; l < lanes; ++l){
+                PC[l] = shared_PC + 2 * skip[l];
+            }
+            converged = false;
+        }
+    };
+
+    bool idle = false;
+    switch(op >> 12){
+        case 0x0:
+            if(op != 0x00E0){
+                return !step_each_lane<Q>(op, true);
+            }
+            for(size_t l = 0; l < lanes; ++l){
+                screen[l].fill(0);
+            }
+        break;
+        case 0x1:
+            shared_PC = NNN;
+            // is_idle_loop() reads up to 4 bytes at NNN
+            if(NNN + 4 <= RAM_SIZE && uniform[NNN] && uniform[NNN + 1] && uniform[NNN + 2] && uniform[NNN + 3]){
+                idle = Chip8::is_idle_loop(ram[0], NNN, pc);
+            }
+        break;
+        case 0x2:
+            // lanes at the same PC may still be at different depths
+            if(std::ranges::any_of(SP.begin(), SP.begin() + lanes, [](uint8_t sp){ return sp == Q::stack_depth; })){
+                return !step_each_lane<Q>(op, true);
+            }
+            for(size_t l = 0; l < lanes; ++l){
+                stack[l][SP[l]++] = shared_PC;
+            }
+            shared_PC = NNN;
+        break;
+        case 0x3:
+            skip_if([&](size_t l){ return eq(load_lanes(vx + l), splat(NN)); });
+        break;
+        case 0x4:
+            skip_if([&](size_t l){ return not_(eq(load_lanes(vx + l), splat(NN))); });
+        break;
+        case 0x5:
+            skip_if([&](size_t l){ return eq(load_lanes(vx + l), load_lanes(vy + l)); });
+        break;
+        case 0x6:
+            std::fill_n(vx, lanes, NN);
+        break;
+        case 0x7:
+            for(size_t l = 0; l < lanes; l += VEC_LANES){
+                store_lanes(vx + l, add(load_lanes(vx + l), splat(NN)));
+            }
+        break;
+        case 0x8:
+            for(size_t l = 0; l < lanes; l += VEC_LANES){
+                const vec_t a = load_lanes(vx + l);
+                const vec_t b = load_lanes(vy + l);
+                // VF is written after VX, it wins when X == F
+                switch(op & 0xF){
+                    case 0x0: store_lanes(vx + l, b); break;
+                    case 0x1: store_lanes(vx + l, or_(a, b)); break;
+                    case 0x2: store_lanes(vx + l, and_(a, b)); break;
+                    case 0x3: store_lanes(vx + l, xor_(a, b)); break;
+                    case 0x4:{
+                        const vec_t sum = add(a, b);
+                        store_lanes(vx + l, sum);
+                        // the saturated sum differs on overflow
+                        store_lanes(vf + l, one(not_(eq(adds(a, b), sum))));
+                    }
+                    break;
+                    case 0x5:
+                        store_lanes(vx + l, sub(a, b));
+                        store_lanes(vf + l, one(ge(a, b)));
+                    break;
+                    case 0x6:{
+                        const vec_t s = Q::copy_vy_to_vx_in_shift ? b : a;
+                        store_lanes(vx + l, shr1(s));
+                        store_lanes(vf + l, one(s));
+                    }
+                    break;
+                    case 0x7:
+                        store_lanes(vx + l, sub(b, a));
+                        store_lanes(vf + l, one(ge(b, a)));
+                    break;
+                    case 0xE:{
+                        const vec_t s = Q::copy_vy_to_vx_in_shift ? b : a;
+                        store_lanes(vx + l, add(s, s));
+                        store_lanes(vf + l, msb(s));
+                    }
+                    break;
+                }
+            }
+        break;
+        case 0x9:
+            skip_if([&](size_t l){ return not_(eq(load_lanes(vx + l), load_lanes(vy + l))); });
+        break;
+        case 0xA:
+            std::fill_n(I.begin(), lanes, NNN);
+        break;
+        case 0xF:
+            switch(NN){
+                case 0x07:
+                    std::copy_n(delay_timer.begin(), lanes, vx);
+                break;
+                case 0x15:
+                    std::copy_n(vx, lanes, delay_timer.begin());
+                break;
+                case 0x18:
+                    std::copy_n(vx, lanes, sound_timer.begin());
+                break;
+                case 0x1E:
+                    for(size_t l = 0; l < lanes; l += WIDE_LANES){
+                        add_widen(&I[l], vx + l);
+                    }
+                break;
+                // FX0A parks the lanes with no key pressed
+                default:
+                    return !step_each_lane<Q>(op, NN == 0x0A);
+            }
+        break;
+        // BNNN, EX9E and EXA1 may send the lanes to different places
+        case 0xB:
+        case 0xE:
+            return !step_each_lane<Q>(op, true);
+        // CXNN and DXYN
+        default:
+            return !step_each_lane<Q>(op, false);
+    }
+
+    ++vector_steps;
+    return !idle;
+}
+
+template<class Q>
+uint64_t Lockstep::run_frame(){
+    int done = 0;
+    while(converged && done < CYCLES_PER_FRAME){
+        // opcodes that differ between lanes can't be fetched once
+        const uint16_t pc = shared_PC;
+        if(pc + 1 >= RAM_SIZE || !uniform[pc] || !uniform[pc + 1]){
+            diverge();
+            break;
+        }
+        ++done;
+        if(!step_converged<Q>()){
+            // like Chip8::run_frame(), the rest of the frame can be skipped
+            done = CYCLES_PER_FRAME;
+        }
+    }
+
+    if(!converged){
+        for(size_t l = 0; l < lanes; ++l){
+            run_lane<Q>(l, CYCLES_PER_FRAME - done);
+        }
+        refresh_uniform();
+        try_converge();
+    }
+
+    tick_timers();
+    return uint64_t(CYCLES_PER_FRAME) * lanes;
+}
+
+uint64_t Lockstep::run_frame(){
+    switch(quirks){
+        case Chip8::quirks_t::cosmac_vip: return run_frame<Chip8::quirks_cosmac_vip>();
+        case Chip8::quirks_t::schip: return run_frame<Chip8::quirks_schip>();
+        case Chip8::quirks_t::modern: return run_frame<Chip8::quirks_modern>();
+    }
+    std::unreachable();
+}
+
+void Lockstep::diverge(){
+    std::fill_n(PC.begin(), lanes, shared_PC);
+    converged = false;
+}
+
+void Lockstep::try_converge(){
+    converged = std::all_of(PC.begin(), PC.begin() + lanes, [this](uint16_t pc){ return pc == PC[0]; });
+    if(converged){
+        shared_PC = PC[0];
+    }
+}
+
+void Lockstep::refresh_uniform(){
+    for(size_t a = 0; a < RAM_SIZE; ++a){
+        if(!written.test(a)){
+            continue;
+        }
+        bool same = true;
+        for(size_t l = 1; l < lanes && same; ++l){
+            same = ram[l][a] == ram[0][a];
+        }
+        uniform[a] = same;
+    }
+    written.reset();
+}
+
+void Lockstep::tick_timers(){
+    for(size_t l = 0; l < lanes; l += VEC_LANES){
+        store_lanes(&delay_timer[l], subs(load_lanes(&delay_timer[l]), splat(1)));
+        store_lanes(&sound_timer[l], subs(load_lanes(&sound_timer[l]), splat(1)));
+    }
+}
+
+size_t Lockstep::get_lanes() const{
+    return lanes;
+}
+
+const std::array<uint64_t, Chip8::SCREEN_HEIGHT>& Lockstep::get_screen_rows(size_t lane) const{
+    return screen[lane];
+}
+
+uint64_t Lockstep::get_screen_hash(size_t lane) const{
+    return Chip8::hash_screen(screen[lane]);
+}
+
+uint8_t Lockstep::get_V(size_t lane, int x) const{
+    return V[x * padded_lanes + lane];
+}
+
+uint16_t Lockstep::get_I(size_t lane) const{
+    return I[lane];
+}
+
+uint16_t Lockstep::get_PC(size_t lane) const{
+    return converged ? shared_PC : PC[lane];
+}
+
+Chip8::fault_t Lockstep::get_fault(size_t lane) const{
+    return fault[lane];
+}
+
+Chip8::state_t Lockstep::snapshot(size_t lane) const{
+    Chip8::state_t s;
+    s.screen = screen[lane];
+    s.ram = ram[lane];
+    s.stack = stack[lane];
+    s.SP = SP[lane];
+    s.fault = fault[lane];
+    s.PC = get_PC(lane);
+    s.I = I[lane];
+    s.keyboard = keyboard[lane];
+    for(int x = 0; x < GPREG_NUM; ++x){
+        s.V[x] = get_V(lane, x);
+    }
+    s.delay_timer = delay_timer[lane];
+    s.sound_timer = sound_timer[lane];
+    s.quirks = quirks;
+    s.rng = rng[lane].get_state();
+    return s;
+}
+
+uint64_t Lockstep::get_vector_steps() const{
+    return vector_steps;
+}
+
+uint64_t Lockstep::get_scalar_steps() const{
+    return scalar_steps;
+}
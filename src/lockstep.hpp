@@ -0,0 +1,118 @@
+#pragma once
+
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "chip8.hpp"
+
+class Lockstep{
+    /*
+        Many instances of the same ROM, typically fed different inputs.
+
+        The registers of all the instances (lanes) are stored as
+        structure-of-arrays: V[x] of every lane is contiguous, then I, the
+        timers, ... As long as every lane is at the same PC with the same
+        opcode there, the ALU instructions, skips and timers run on whole
+        vectors of lanes (AVX2, SSE2 or plain loops, whatever the build
+        targets); the rest runs once per lane, through the same
+        Chip8::execute() as a Chip8. When lanes end up at different PCs
+        each of them runs on its own until the end of the frame, and they
+        are merged back if they meet at the same PC.
+
+        Behaves like one Chip8 (interpreter backend) per lane, each lane
+        has its own CXNN generator. tests/lockstep_test.cpp checks it.
+    */
+
+    public:
+    explicit Lockstep(size_t lanes);
+
+    void load(const std::vector<uint8_t>& prog, Chip8::quirks_t q = Chip8::quirks_t::modern);
+    // bit k set means key k is pressed
+    void set_keyboard(size_t lane, uint16_t keys);
+    // see Chip8::seed(), lanes start with Chip8::DEFAULT_SEED
+    void seed(size_t lane, uint64_t s);
+    // one frame on every lane, see Chip8::run_frame(). Returns the
+    // instructions executed, summed over the lanes
+    uint64_t run_frame();
+
+    size_t get_lanes() const;
+    const std::array<uint64_t, Chip8::SCREEN_HEIGHT>& get_screen_rows(size_t lane) const;
+    // same hash as Chip8::get_screen_hash()
+    uint64_t get_screen_hash(size_t lane) const;
+    uint8_t get_V(size_t lane, int x) const;
+    uint16_t get_I(size_t lane) const;
+    uint16_t get_PC(size_t lane) const;
+    // see Chip8::get_fault(), a faulted lane stays parked at the faulting
+    // instruction
+    Chip8::fault_t get_fault(size_t lane) const;
+    // everything about one lane, what Chip8::snapshot() returns for the
+    // Chip8 that lane stands for
+    Chip8::state_t snapshot(size_t lane) const;
+    // instructions run once for all the lanes, and once per lane
+    uint64_t get_vector_steps() const;
+    uint64_t get_scalar_steps() const;
+
+    private:
+    static constexpr auto RAM_SIZE = Chip8::RAM_SIZE;
+    static constexpr auto GPREG_NUM = Chip8::GPREG_NUM;
+    // Chip8's defaults, ips / refresh_rate
+    static constexpr int CYCLES_PER_FRAME = Chip8::DEFAULT_IPS / Chip8::DEFAULT_REFRESH_RATE;
+    // lanes are padded to a multiple of the widest vector
+    static constexpr size_t LANE_PADDING = 32;
+
+    size_t lanes;
+    size_t padded_lanes;
+    Chip8::quirks_t quirks = Chip8::quirks_t::modern;
+
+    // V[x * padded_lanes + lane]
+    std::vector<uint8_t> V;
+    std::vector<uint16_t> I;
+    std::vector<uint8_t> delay_timer;
+    std::vector<uint8_t> sound_timer;
+    std::vector<uint16_t> keyboard;
+    // only up to date while the lanes are diverged
+    std::vector<uint16_t> PC;
+    std::vector<std::array<uint16_t, Chip8::MAX_STACK_DEPTH>> stack;
+    std::vector<uint8_t> SP;
+    std::vector<Chip8::fault_t> fault;
+    std::vector<std::array<uint8_t, RAM_SIZE>> ram;
+    std::vector<std::array<uint64_t, Chip8::SCREEN_HEIGHT>> screen;
+    // per lane results of a skip
+    std::vector<uint8_t> skip;
+
+    // every lane is at shared_PC
+    bool converged = true;
+    uint16_t shared_PC = 0x200;
+    // bytes equal in every lane's ram, so an opcode can be fetched once
+    std::bitset<RAM_SIZE> uniform;
+    // written since the last refresh_uniform()
+    std::bitset<RAM_SIZE> written;
+
+    std::vector<Xoshiro128> rng;
+    uint64_t vector_steps = 0;
+    uint64_t scalar_steps = 0;
+
+    uint8_t* reg(int x);
+    // one lane as Chip8::execute() sees it, see lockstep.cpp
+    struct lane_t;
+    lane_t get_lane(size_t lane);
+    // executes op (already fetched, PC past it) on one lane. Returns true
+    // when the lane can't change anything before the next frame
+    template<class Q> bool execute(lane_t& m, uint16_t op);
+    // up to n instructions on one lane, stops early if it gets parked
+    template<class Q> void run_lane(size_t lane, int n);
+    // one instruction at shared_PC on every lane, returns false if the
+    // lanes have nothing to do before the next frame
+    template<class Q> bool step_converged();
+    // executes op on every lane one by one, then checks whether they're
+    // still converged if op may_branch. Returns true if every lane got parked
+    template<class Q> bool step_each_lane(uint16_t op, bool may_branch);
+    template<class Q> uint64_t run_frame();
+    void diverge();
+    void try_converge();
+    void refresh_uniform();
+    void tick_timers();
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+
+// instructions told apart down to their sub-operation, in the order of the
+// opcodes. Every backend executes what decode_op() says and Profile counts
+// the same classes, so an opcode means the same thing everywhere
+enum op_t : uint8_t{
+    OP_00E0, OP_00EE,
+    OP_0NNN, // machine code routines, not supported: they do nothing
+    OP_1NNN, OP_2NNN, OP_3XNN, OP_4XNN, OP_5XY0, OP_6XNN, OP_7XNN,
+    OP_8XY0, OP_8XY1, OP_8XY2, OP_8XY3, OP_8XY4, OP_8XY5, OP_8XY6, OP_8XY7, OP_8XYE,
+    OP_9XY0, OP_ANNN, OP_BNNN, OP_CXNN, OP_DXYN, OP_EX9E, OP_EXA1,
+    OP_FX07, OP_FX0A, OP_FX15, OP_FX18, OP_FX1E, OP_FX29, OP_FX33, OP_FX55, OP_FX65,
+    OP_NONE, // opcodes that aren't instructions (8XY8, EX00, ...), they do nothing too
+    OPS
+};
+
+// 5XYN and 9XYN are 5XY0 and 9XY0 whatever N is
+constexpr op_t decode_op(uint16_t opcode){
+    const int N = opcode & 0xF;
+    const int NN = opcode & 0xFF;
+
+    switch(opcode >> 12){
+        case 0x0:
+            if(opcode == 0x00E0){
+                return OP_00E0;
+            }
+            return opcode == 0x00EE ? OP_00EE : OP_0NNN;
+        case 0x1: return OP_1NNN;
+        case 0x2: return OP_2NNN;
+        case 0x3: return OP_3XNN;
+        case 0x4: return OP_4XNN;
+        case 0x5: return OP_5XY0;
+        case 0x6: return OP_6XNN;
+        case 0x7: return OP_7XNN;
+        case 0x8:
+            if(N <= 0x7){
+                return op_t(OP_8XY0 + N);
+            }
+            return N == 0xE ? OP_8XYE : OP_NONE;
+        case 0x9: return OP_9XY0;
+        case 0xA: return OP_ANNN;
+        case 0xB: return OP_BNNN;
+        case 0xC: return OP_CXNN;
+        case 0xD: return OP_DXYN;
+        case 0xE:
+            if(NN == 0x9E){
+                return OP_EX9E;
+            }
+            return NN == 0xA1 ? OP_EXA1 : OP_NONE;
+    }
+    switch(NN){
+        case 0x07: return OP_FX07;
+        case 0x0A: return OP_FX0A;
+        case 0x15: return OP_FX15;
+        case 0x18: return OP_FX18;
+        case 0x1E: return OP_FX1E;
+        case 0x29: return OP_FX29;
+        case 0x33: return OP_FX33;
+        case 0x55: return OP_FX55;
+        case 0x65: return OP_FX65;
+    }
+    return OP_NONE;
+}
@@ -0,0 +1,100 @@
+#include "perf_counters.hpp"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define PERF_COUNTERS_SUPPORTED
+#endif
+
+#ifdef PERF_COUNTERS_SUPPORTED
+namespace{
+
+int open_event(uint32_t type, uint64_t config){
+    perf_event_attr attr{};
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    // this thread, on any cpu
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+}
+#endif
+
+PerfCounters::PerfCounters(){
+    fds.fill(-1);
+#ifdef PERF_COUNTERS_SUPPORTED
+    fds[CYCLES] = open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    fds[INSTRUCTIONS] = open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    fds[BRANCH_MISSES] = open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    fds[L1D_MISSES] = open_event(PERF_TYPE_HW_CACHE,
+        PERF_COUNT_HW_CACHE_L1D | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16
+    );
+#endif
+}
+
+PerfCounters::~PerfCounters(){
+#ifdef PERF_COUNTERS_SUPPORTED
+    for(int fd : fds){
+        if(fd >= 0){
+            close(fd);
+        }
+    }
+#endif
+}
+
+bool PerfCounters::available() const{
+    for(int fd : fds){
+        if(fd >= 0){
+            return true;
+        }
+    }
+    return false;
+}
+
+void PerfCounters::start(){
+#ifdef PERF_COUNTERS_SUPPORTED
+    for(int fd : fds){
+        if(fd >= 0){
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#endif
+}
+
+void PerfCounters::stop(){
+#ifdef PERF_COUNTERS_SUPPORTED
+    for(int fd : fds){
+        if(fd >= 0){
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+#endif
+}
+
+PerfCounters::counts_t PerfCounters::read() const{
+    counts_t counts;
+    counts.fill(-1);
+#ifdef PERF_COUNTERS_SUPPORTED
+    for(int e = 0; e < EVENTS; ++e){
+        // value, time enabled, time running
+        uint64_t values[3];
+        if(fds[e] < 0 || ::read(fds[e], values, sizeof(values)) != sizeof(values)){
+            continue;
+        }
+        if(values[2] == 0){
+            // never got a hardware counter
+            continue;
+        }
+        counts[e] = values[2] < values[1] ? int64_t(double(values[0]) * values[1] / values[2]) : int64_t(values[0]);
+    }
+#endif
+    return counts;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+class PerfCounters{
+    /*
+        Hardware performance counters of the calling thread, through Linux
+        perf_event_open. Only user space is counted, which is allowed with
+        the default perf_event_paranoid (2).
+
+        Every event is opened on its own, so whatever the host or the VM
+        doesn't support is reported as unavailable and the rest still
+        works. When the kernel multiplexes the counters, the counts are
+        scaled by the time each one actually ran. Nothing is available on
+        other systems.
+    */
+
+    public:
+    enum event_t{
+        CYCLES,
+        INSTRUCTIONS,
+        BRANCH_MISSES,
+        L1D_MISSES, // L1 data cache read misses
+        EVENTS
+    };
+
+    static constexpr std::array<std::string_view, EVENTS> EVENT_NAMES{
+        "cycles", "instructions", "branch_misses", "l1d_misses"
+    };
+
+    // what the counters counted between start() and stop(), -1 for the
+    // unavailable ones
+    using counts_t = std::array<int64_t, EVENTS>;
+
+    PerfCounters();
+    ~PerfCounters();
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    // false if no event could be opened
+    bool available() const;
+    // resets and starts every counter
+    void start();
+    void stop();
+    counts_t read() const;
+
+    private:
+    std::array<int, EVENTS> fds;
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+class Xoshiro128{
+    /*
+        xoshiro128** by David Blackman and Sebastiano Vigna.
+
+        https://prng.di.unimi.it/
+
+        16 bytes of state and a handful of instructions per number, so every
+        Chip8 can own one and snapshot it with the rest of the machine.
+    */
+
+    public:
+    using state_t = std::array<uint32_t, 4>;
+
+    explicit Xoshiro128(uint64_t seed = 0){
+        this->seed(seed);
+    }
+
+    // expands the seed with splitmix64, as recommended by the authors
+    void seed(uint64_t seed){
+        for(int i = 0; i < 4; i += 2){
+            seed += 0x9E3779B97F4A7C15;
+            uint64_t z = seed;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+            z ^= z >> 31;
+            s[i] = uint32_t(z);
+            s[i + 1] = uint32_t(z >> 32);
+        }
+    }
+
+    uint32_t next(){
+        const uint32_t result = rotl(s[1] * 5, 7) * 9;
+        const uint32_t t = s[1] << 9;
+
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 11);
+
+        return result;
+    }
+
+    const state_t& get_state() const{
+        return s;
+    }
+
+    void set_state(const state_t& state){
+        s = state;
+    }
+
+    private:
+    state_t s;
+
+    static uint32_t rotl(uint32_t x, int k){
+        return (x << k) | (x >> (32 - k));
+    }
+};
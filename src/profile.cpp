@@ -0,0 +1,45 @@
+#include "profile.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <print>
+
+void Profile::clear(){
+    *this = Profile{};
+}
+
+void Profile::write_json(std::FILE* f, int max_pcs) const{
+    std::println(f, "{{");
+    std::println(f, "  \"instructions\": {},", instructions);
+    std::println(f, "  \"jit_blocks\": {},", blocks);
+    std::println(f, "  \"jit_block_instructions\": {},", block_instructions);
+    std::println(f, "  \"draws\": {},", draws);
+    std::println(f, "  \"skips_taken\": {},", skips_taken);
+
+    std::println(f, "  \"opcodes\": {{");
+    bool first = true;
+    for(size_t c = 0; c < per_class.size(); ++c){
+        if(per_class[c] == 0){
+            continue;
+        }
+        std::print(f, "{}    \"{}\": {}", first ? "" : ",\n", CLASS_NAMES[c], per_class[c]);
+        first = false;
+    }
+    std::println(f, "{}  }},", first ? "" : "\n");
+
+    std::array<uint16_t, ADDRESSES> order;
+    std::iota(order.begin(), order.end(), 0);
+    const auto hot = std::ranges::count_if(per_pc, [](uint64_t n){ return n != 0; });
+    const auto shown = std::min<ptrdiff_t>(hot, max_pcs);
+    // hottest first, lower addresses first among equals
+    std::ranges::partial_sort(order, order.begin() + shown, [this](uint16_t a, uint16_t b){
+        return per_pc[a] != per_pc[b] ? per_pc[a] > per_pc[b] : a < b;
+    });
+
+    std::println(f, "  \"hot_pcs\": [");
+    for(ptrdiff_t i = 0; i < shown; ++i){
+        std::println(f, "    {{\"pc\": \"0x{:03X}\", \"count\": {}}}{}", order[i], per_pc[order[i]], i + 1 < shown ? "," : "");
+    }
+    std::println(f, "  ]");
+    std::println(f, "}}");
+}
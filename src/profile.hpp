@@ -0,0 +1,70 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <string_view>
+
+#include "opcodes.hpp"
+
+class Profile{
+    /*
+        Execution counters of one Chip8, only kept when the library is built
+        with CHIP8EMU_PROFILE (cmake -DCHIP8EMU_PROFILE=ON). Otherwise none
+        of the PROFILE() calls in the core are compiled in.
+
+        Counted per opcode class (8XY4, FX1E, ...) and per address of the
+        instruction. Blocks run by the JIT are counted as a whole at their
+        first address, see count_block(), and the skips they take aren't
+        seen. Instructions fast-forwarded by Chip8::run_frame() are never
+        executed, so they aren't counted.
+    */
+
+    public:
+    static constexpr auto ADDRESSES = 4096;
+
+    // opcode classes, indexed by op_t
+    static constexpr std::array<std::string_view, OPS> CLASS_NAMES{
+        "00E0", "00EE", "0NNN", "1NNN", "2NNN", "3XNN", "4XNN", "5XY0",
+        "6XNN", "7XNN", "8XY0", "8XY1", "8XY2", "8XY3", "8XY4", "8XY5",
+        "8XY6", "8XY7", "8XYE", "9XY0", "ANNN", "BNNN", "CXNN", "DXYN",
+        "EX9E", "EXA1", "FX07", "FX0A", "FX15", "FX18", "FX1E", "FX29",
+        "FX33", "FX55", "FX65", "invalid"
+    };
+
+    // index in CLASS_NAMES
+    static int classify(uint16_t opcode){
+        return decode_op(opcode);
+    }
+
+    void count(uint16_t pc, uint16_t opcode){
+        ++per_class[classify(opcode)];
+        ++per_pc[pc % ADDRESSES];
+        ++instructions;
+    }
+    // a JIT block of len instructions starting at pc
+    void count_block(uint16_t pc, int len){
+        ++per_pc[pc % ADDRESSES];
+        ++blocks;
+        block_instructions += len;
+    }
+    void count_draw(){
+        ++draws;
+    }
+    void count_skip(){
+        ++skips_taken;
+    }
+
+    void clear();
+    // hot_pcs lists the hottest addresses first, at most max_pcs of them
+    void write_json(std::FILE* f, int max_pcs = 64) const;
+
+    private:
+    std::array<uint64_t, CLASS_NAMES.size()> per_class{};
+    std::array<uint64_t, ADDRESSES> per_pc{};
+    uint64_t instructions = 0; // one by one, not in JIT blocks
+    uint64_t blocks = 0;
+    uint64_t block_instructions = 0;
+    uint64_t draws = 0;
+    uint64_t skips_taken = 0;
+};
@@ -0,0 +1,206 @@
+#include "rewind.hpp"
+
+#include <bit>
+#include <cstddef>
+#include <cstring>
+
+namespace{
+
+// everything in state_t after the screen and ram, stored whole in a delta
+constexpr size_t REGS_OFFSET = offsetof(Chip8::state_t, stack);
+constexpr size_t REGS_SIZE = sizeof(Chip8::state_t) - REGS_OFFSET;
+static_assert(offsetof(Chip8::state_t, screen) < REGS_OFFSET && offsetof(Chip8::state_t, ram) < REGS_OFFSET);
+
+// ram is compared and stored in words of this size
+constexpr size_t WORD = 8;
+constexpr size_t WORDS = sizeof(Chip8::state_t::ram) / WORD;
+
+// header of a run of changed ram words in a delta
+struct run_t{
+    uint16_t first_word;
+    uint16_t words;
+};
+
+// the registers, every row of the screen and all of ram as one run: every
+// run but the first is preceded by an unchanged word, which costs more
+// than its header
+constexpr size_t MAX_DELTA_SIZE = REGS_SIZE + sizeof(uint32_t) + sizeof(Chip8::state_t::screen)
+    + sizeof(run_t) + sizeof(Chip8::state_t::ram);
+static_assert(sizeof(run_t) <= WORD);
+
+template<class T>
+void put(uint8_t*& out, const T& value){
+    std::memcpy(out, &value, sizeof(T));
+    out += sizeof(T);
+}
+
+template<class T>
+T get(const uint8_t*& in){
+    T value;
+    std::memcpy(&value, in, sizeof(T));
+    in += sizeof(T);
+    return value;
+}
+
+}
+
+Rewind::Rewind(size_t budget_bytes, int keyframe_interval) :
+    buffer(budget_bytes),
+    keyframe_interval(keyframe_interval)
+{
+    // a keyframe has to fit, with room for the history around it
+    assert(budget_bytes >= 4 * sizeof(Chip8::state_t));
+    assert(keyframe_interval > 0);
+    scratch.resize(MAX_DELTA_SIZE);
+}
+
+void Rewind::push(const Chip8::state_t& s){
+    if(has_newest){
+        if(++since_keyframe >= keyframe_interval){
+            append(reinterpret_cast<const uint8_t*>(&newest), sizeof(newest), true);
+            since_keyframe = 0;
+        }
+        else{
+            append(scratch.data(), encode_delta(newest, s), false);
+        }
+    }
+
+    newest = s;
+    has_newest = true;
+}
+
+uint32_t Rewind::encode_delta(const Chip8::state_t& older, const Chip8::state_t& newer){
+    uint8_t* out = scratch.data();
+
+    std::memcpy(out, reinterpret_cast<const uint8_t*>(&older) + REGS_OFFSET, REGS_SIZE);
+    out += REGS_SIZE;
+
+    uint32_t rows = 0;
+    for(int y = 0; y < Chip8::SCREEN_HEIGHT; ++y){
+        rows |= uint32_t(older.screen[y] != newer.screen[y]) << y;
+    }
+    put(out, rows);
+    for(uint32_t r = rows; r; r &= r - 1){
+        put(out, older.screen[std::countr_zero(r)]);
+    }
+
+    // runs of changed words until the end of the entry
+    for(size_t w = 0; w < WORDS;){
+        if(std::memcmp(&older.ram[w * WORD], &newer.ram[w * WORD], WORD) == 0){
+            ++w;
+            continue;
+        }
+        size_t end = w + 1;
+        while(end < WORDS && std::memcmp(&older.ram[end * WORD], &newer.ram[end * WORD], WORD) != 0){
+            ++end;
+        }
+        put(out, run_t{uint16_t(w), uint16_t(end - w)});
+        std::memcpy(out, &older.ram[w * WORD], (end - w) * WORD);
+        out += (end - w) * WORD;
+        w = end;
+    }
+
+    assert(size_t(out - scratch.data()) <= MAX_DELTA_SIZE);
+    return out - scratch.data();
+}
+
+void Rewind::apply(const entry_t& e, Chip8::state_t& s) const{
+    const uint8_t* in = &buffer[e.offset];
+    if(e.keyframe){
+        std::memcpy(&s, in, sizeof(s));
+        return;
+    }
+
+    const uint8_t* end = in + e.size;
+    std::memcpy(reinterpret_cast<uint8_t*>(&s) + REGS_OFFSET, in, REGS_SIZE);
+    in += REGS_SIZE;
+
+    for(uint32_t r = get<uint32_t>(in); r; r &= r - 1){
+        s.screen[std::countr_zero(r)] = get<uint64_t>(in);
+    }
+
+    while(in < end){
+        const run_t run = get<run_t>(in);
+        std::memcpy(&s.ram[run.first_word * WORD], in, run.words * WORD);
+        in += run.words * WORD;
+    }
+}
+
+void Rewind::append(const uint8_t* data, uint32_t size, bool keyframe){
+    // entries don't wrap around, the end of the buffer is left unused.
+    // Whatever is still past head is the oldest history, it goes first
+    if(head + size > buffer.size()){
+        while(!entries.empty() && entries.front().offset >= head){
+            used -= entries.front().size;
+            entries.pop_front();
+        }
+        head = 0;
+    }
+    // the oldest entries are right after head, drop those in the way
+    while(!entries.empty()){
+        const entry_t& oldest = entries.front();
+        if(oldest.offset >= head + size || oldest.offset + oldest.size <= head){
+            break;
+        }
+        used -= oldest.size;
+        entries.pop_front();
+    }
+
+    std::memcpy(&buffer[head], data, size);
+    entries.push_back({head, size, keyframe});
+    head += size;
+    used += size;
+}
+
+bool Rewind::step_back(Chip8::state_t& s, size_t n){
+    if(n == 0 || n > entries.size()){
+        return false;
+    }
+
+    // from the closest keyframe on the way if there's one, otherwise
+    // from the newest state
+    const size_t target = entries.size() - n;
+    size_t from = entries.size();
+    for(size_t i = target; i < entries.size(); ++i){
+        if(entries[i].keyframe){
+            from = i;
+            break;
+        }
+    }
+    if(from < entries.size()){
+        apply(entries[from], newest);
+    }
+    for(size_t i = from; i-- > target;){
+        apply(entries[i], newest);
+    }
+
+    head = entries[target].offset;
+    while(entries.size() > target){
+        used -= entries.back().size;
+        entries.pop_back();
+    }
+    // keyframes stay spaced out the same way
+    since_keyframe = 0;
+    for(size_t i = entries.size(); i-- > 0 && !entries[i].keyframe;){
+        ++since_keyframe;
+    }
+
+    s = newest;
+    return true;
+}
+
+size_t Rewind::get_frames() const{
+    return entries.size();
+}
+
+size_t Rewind::get_bytes() const{
+    return used;
+}
+
+void Rewind::clear(){
+    entries.clear();
+    head = 0;
+    used = 0;
+    since_keyframe = 0;
+    has_newest = false;
+}
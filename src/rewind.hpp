@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "chip8.hpp"
+
+class Rewind{
+    /*
+        History of the last frames for stepping backwards, bounded in bytes.
+
+        The newest state is kept whole. Every older frame is stored as what
+        differs from the frame after it (the registers, the changed screen
+        rows and the changed 8-byte words of ram), so going one frame back
+        is applying one small delta. Every keyframe_interval frames the
+        whole state is stored instead, which bounds the work of going many
+        frames back at once.
+
+        Entries live in one byte ring buffer, the oldest ones are dropped
+        to make room.
+    */
+
+    public:
+    explicit Rewind(size_t budget_bytes = 4 << 20, int keyframe_interval = 300);
+
+    // records s as the newest frame, call it once per frame
+    void push(const Chip8::state_t& s);
+    // drops the newest n frames and writes the state that is now the newest
+    // into s. Returns false (and leaves s alone) if there aren't n older frames
+    bool step_back(Chip8::state_t& s, size_t n = 1);
+    // frames step_back() can go back
+    size_t get_frames() const;
+    // bytes taken in the ring buffer
+    size_t get_bytes() const;
+    void clear();
+
+    private:
+    struct entry_t{
+        uint32_t offset;
+        uint32_t size;
+        bool keyframe;
+    };
+
+    std::vector<uint8_t> buffer;
+    std::deque<entry_t> entries; // oldest first
+    uint32_t head = 0; // where the next entry goes
+    size_t used = 0;
+    int keyframe_interval;
+    int since_keyframe = 0;
+
+    Chip8::state_t newest;
+    bool has_newest = false;
+    // sized for the largest delta, see encode_delta()
+    std::vector<uint8_t> scratch;
+
+    // encodes older as a delta against newer at the start of scratch,
+    // returns its size
+    uint32_t encode_delta(const Chip8::state_t& older, const Chip8::state_t& newer);
+    // turns s (the frame after e) into the frame of e
+    void apply(const entry_t& e, Chip8::state_t& s) const;
+    void append(const uint8_t* data, uint32_t size, bool keyframe);
+};
@@ -0,0 +1,134 @@
+#include "tracer.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#define TRACER_MMAP_SUPPORTED
+#endif
+
+Tracer::Tracer(size_t capacity){
+    capacity = std::bit_ceil(std::max<size_t>(capacity, 1));
+    bytes = sizeof(header_t) + capacity * sizeof(record_t);
+    memory.resize((bytes + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+    header = reinterpret_cast<header_t*>(memory.data());
+    init(capacity);
+}
+
+Tracer::Tracer(const char* path, size_t capacity){
+#ifdef TRACER_MMAP_SUPPORTED
+    capacity = std::bit_ceil(std::max<size_t>(capacity, 1));
+    bytes = sizeof(header_t) + capacity * sizeof(record_t);
+
+    const int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0){
+        return;
+    }
+    void* mem = MAP_FAILED;
+    if(ftruncate(fd, bytes) == 0){
+        mem = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    // the mapping keeps the file alive
+    close(fd);
+    if(mem == MAP_FAILED){
+        return;
+    }
+
+    header = static_cast<header_t*>(mem);
+    mapped = true;
+    init(capacity);
+#else
+    (void)path;
+    (void)capacity;
+#endif
+}
+
+Tracer::~Tracer(){
+#ifdef TRACER_MMAP_SUPPORTED
+    if(mapped){
+        munmap(header, bytes);
+    }
+#endif
+}
+
+void Tracer::init(size_t capacity){
+    header->magic = MAGIC;
+    header->version = VERSION;
+    header->capacity = capacity;
+    header->written = 0;
+    records = reinterpret_cast<record_t*>(header + 1);
+}
+
+bool Tracer::is_open() const{
+    return header != nullptr;
+}
+
+uint64_t Tracer::get_written() const{
+    return header->written;
+}
+
+std::vector<Tracer::record_t> Tracer::get_records() const{
+    const uint64_t capacity = header->capacity;
+    const uint64_t written = header->written;
+    std::vector<record_t> out;
+    out.reserve(std::min(written, capacity));
+    for(uint64_t n = written - std::min(written, capacity); n < written; ++n){
+        out.push_back(records[n & (capacity - 1)]);
+    }
+    return out;
+}
+
+void Tracer::clear(){
+    header->written = 0;
+}
+
+bool Tracer::save(const char* path) const{
+    std::FILE* f = std::fopen(path, "wb");
+    if(!f){
+        return false;
+    }
+    const bool ok = std::fwrite(header, 1, bytes, f) == bytes;
+    return std::fclose(f) == 0 && ok;
+}
+
+bool Tracer::load(const char* path, std::vector<record_t>& out, uint64_t& first){
+    std::FILE* f = std::fopen(path, "rb");
+    if(!f){
+        return false;
+    }
+
+    // the ring takes the rest of the file, capacity has to say so before
+    // anything is allocated for it
+    long size = -1;
+    if(std::fseek(f, 0, SEEK_END) == 0){
+        size = std::ftell(f);
+    }
+    header_t h;
+    bool ok = size >= long(sizeof(h)) && std::fseek(f, 0, SEEK_SET) == 0
+        && std::fread(&h, sizeof(h), 1, f) == 1
+        && h.magic == MAGIC && h.version == VERSION
+        && h.capacity > 0 && std::has_single_bit(h.capacity)
+        && (size - sizeof(h)) % sizeof(record_t) == 0
+        && h.capacity == (size - sizeof(h)) / sizeof(record_t);
+    std::vector<record_t> ring;
+    if(ok){
+        ring.resize(h.capacity);
+        ok = std::fread(ring.data(), sizeof(record_t), ring.size(), f) == ring.size();
+    }
+    std::fclose(f);
+    if(!ok){
+        return false;
+    }
+
+    // same order as get_records()
+    first = h.written - std::min(h.written, h.capacity);
+    out.clear();
+    for(uint64_t n = first; n < h.written; ++n){
+        out.push_back(ring[n & (h.capacity - 1)]);
+    }
+    return true;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class Tracer{
+    /*
+        Execution trace of a Chip8, one fixed-size binary record per
+        instruction, see Chip8::set_tracer().
+
+        Records go to a ring that keeps the last capacity ones. The ring is
+        either in memory (save() writes it out) or mapped onto a file, which
+        then holds a valid trace at any time, even if the process dies.
+        Both write the same format, tools/trace.cpp decodes and diffs it.
+    */
+
+    public:
+    static constexpr uint8_t NO_REG = 0xFF;
+
+    struct record_t{
+        uint16_t PC;
+        uint16_t opcode;
+        uint16_t I; // after the instruction
+        // lowest V register the instruction changed and its new value,
+        // NO_REG if it didn't change any
+        uint8_t reg;
+        uint8_t value;
+    };
+
+    // start of a trace file, followed by the ring of records
+    struct header_t{
+        std::array<char, 4> magic;
+        uint32_t version;
+        uint64_t capacity; // records in the ring, a power of two
+        uint64_t written; // records pushed so far
+    };
+
+    static constexpr std::array<char, 4> MAGIC{'C', '8', 'T', 'R'};
+    static constexpr uint32_t VERSION = 1;
+
+    // in memory, capacity is rounded up to a power of two
+    explicit Tracer(size_t capacity = 1 << 20);
+    // mapped onto path, which is created or truncated
+    Tracer(const char* path, size_t capacity);
+    ~Tracer();
+    Tracer(const Tracer&) = delete;
+    Tracer& operator=(const Tracer&) = delete;
+
+    // false if the file couldn't be mapped
+    bool is_open() const;
+
+    void push(const record_t& r){
+        records[header->written & (header->capacity - 1)] = r;
+        ++header->written;
+    }
+
+    uint64_t get_written() const;
+    // the records still in the ring, oldest first. The oldest one is
+    // record number get_written() - size() of the run
+    std::vector<record_t> get_records() const;
+    void clear();
+    bool save(const char* path) const;
+
+    // reads a file written by save() or by a mapped Tracer, false if it
+    // isn't one (or is truncated). first is the number of the oldest record
+    // in out
+    static bool load(const char* path, std::vector<record_t>& out, uint64_t& first);
+
+    private:
+    header_t* header = nullptr;
+    record_t* records = nullptr;
+    size_t bytes = 0;
+    std::vector<uint64_t> memory; // backs the in-memory ring
+    bool mapped = false;
+
+    void init(size_t capacity);
+};
+
+static_assert(sizeof(Tracer::record_t) == 8);
+static_assert(sizeof(Tracer::header_t) % alignof(Tracer::record_t) == 0);
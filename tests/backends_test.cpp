@@ -0,0 +1,187 @@
+#include "chip8.hpp"
+#include "compare_state.hpp"
+
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <print>
+#include <random>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// every backend against the interpreter, same ROM, seed and keys, the
+// whole state_t compared after every frame. Exits with 1 on the first
+// difference
+
+namespace{
+
+constexpr int ROM_FRAMES = 600;
+constexpr int RANDOM_ROMS = 300;
+constexpr int RANDOM_FRAMES = 60;
+// programs are loaded at START, ram is 4 KiB
+constexpr uint16_t START = 0x200;
+constexpr uint16_t RAM_END = 0x1000;
+
+using backend_t = Chip8::backend_t;
+
+// the interpreter first, the others are compared to it
+constexpr std::array<std::pair<backend_t, std::string_view>, 5> BACKENDS{{
+    {backend_t::interpreter, "interpreter"},
+    {backend_t::predecoded, "predecoded"},
+    {backend_t::threaded, "threaded"},
+    {backend_t::opcode_table, "opcode_table"},
+    {backend_t::jit_x64, "jit_x64"},
+}};
+
+// held for a few frames, then released
+uint16_t keys(int frame){
+    return (frame / 4) % 3 ? 0 : uint16_t(1) << (frame / 12 % 16);
+}
+
+bool run(const std::string& name, const std::vector<uint8_t>& rom, Chip8::quirks_t q, int frames, const std::vector<size_t>& backends){
+    std::vector<Chip8> chips(backends.size());
+    for(size_t b = 0; b < backends.size(); ++b){
+        chips[b].load(rom, q);
+        chips[b].set_backend(BACKENDS[backends[b]].first);
+    }
+
+    for(int f = 0; f < frames; ++f){
+        for(auto& c : chips){
+            c.set_keyboard(keys(f));
+            c.run_frame();
+        }
+
+        const Chip8::state_t expected = chips[0].snapshot();
+        for(size_t b = 1; b < backends.size(); ++b){
+            if(const char* field = compare(expected, chips[b].snapshot())){
+                std::println(stderr, "{}: {} differs in {} after frame {}", name, BACKENDS[backends[b]].second, field, f);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// anything whose behavior is defined, which is any opcode: code that
+// writes over itself, I and PC near the end of ram (fetches and memory
+// accesses wrap around it), stack faults, opcodes that aren't instructions
+std::vector<uint8_t> random_rom(std::mt19937& gen){
+    // code at the start of the program, and a few instructions right
+    // before the end of ram
+    constexpr uint16_t TAIL = RAM_END - 16;
+    const int body = 16 + gen() % 200;
+
+    auto reg = [&]{ return uint16_t(gen() % 16); };
+    auto byte = [&]{ return uint16_t(gen() % 256); };
+    // I: mostly the code itself, around the end of ram, anywhere
+    auto data_addr = [&]() -> uint16_t{
+        switch(gen() % 4){
+            case 0: return TAIL + gen() % 16;
+            case 1: return gen() % RAM_END;
+        }
+        return START + gen() % (2 * body);
+    };
+    // jumps: an instruction of the code or of the tail, odd addresses
+    // included, or anywhere
+    auto code_addr = [&]() -> uint16_t{
+        switch(gen() % 8){
+            case 0: return TAIL + gen() % 16;
+            case 1: return gen() % RAM_END;
+        }
+        return START + 2 * (gen() % body);
+    };
+    auto op = [&]() -> uint16_t{
+        constexpr std::array<uint16_t, 9> ALU{0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7, 0xE};
+        constexpr std::array<uint16_t, 6> SKIPS{0x3000, 0x4000, 0x5000, 0x9000, 0xE09E, 0xE0A1};
+        constexpr std::array<uint16_t, 5> MEMORY{0xF033, 0xF055, 0xF065, 0xF01E, 0xF029};
+        constexpr std::array<uint16_t, 4> TIMERS{0xF007, 0xF015, 0xF018, 0xF00A};
+        switch(gen() % 16){
+            case 0: return 0x6000 | reg() << 8 | byte();
+            case 1: return 0x7000 | reg() << 8 | byte();
+            case 2: return 0xC000 | reg() << 8 | byte();
+            case 3:{
+                const uint16_t skip = SKIPS[gen() % SKIPS.size()];
+                return skip | reg() << 8 | (skip >> 12 == 0xE ? 0 : byte());
+            }
+            case 4: return 0x1000 | code_addr();
+            case 5: return 0x2000 | code_addr();
+            // returns without a call fault, not too many of them
+            case 6: return gen() % 4 ? 0x00E0 : 0x00EE;
+            case 7: return 0xB000 | code_addr();
+            case 8: return 0xA000 | data_addr();
+            case 9: return 0xD000 | reg() << 8 | reg() << 4 | (gen() % 16);
+            case 10:
+            case 11: return MEMORY[gen() % MEMORY.size()] | reg() << 8;
+            case 12: return TIMERS[gen() % TIMERS.size()] | reg() << 8;
+            // any opcode, instruction or not
+            case 13: return gen();
+        }
+        return 0x8000 | reg() << 8 | reg() << 4 | ALU[gen() % ALU.size()];
+    };
+
+    std::vector<uint8_t> rom(RAM_END - START);
+    auto emit = [&](uint16_t addr, uint16_t opcode){
+        rom[addr - START] = opcode >> 8;
+        rom[addr - START + 1] = opcode & 0xFF;
+    };
+    // I starts out somewhere stores land on something
+    emit(START, 0xA000 | data_addr());
+    for(int i = 1; i < body; ++i){
+        emit(START + 2 * i, op());
+    }
+    for(uint16_t addr = TAIL; addr < RAM_END; addr += 2){
+        emit(addr, op());
+    }
+    return rom;
+}
+
+}
+
+int main(){
+    // the backends this host runs, always the interpreter
+    std::vector<size_t> backends;
+    for(size_t b = 0; b < BACKENDS.size(); ++b){
+        Chip8 c;
+        if(c.set_backend(BACKENDS[b].first)){
+            backends.push_back(b);
+        }
+        else{
+            std::println("{} not available, skipped", BACKENDS[b].second);
+        }
+    }
+
+    int roms = 0;
+    std::vector<std::filesystem::path> paths;
+    for(const auto& entry : std::filesystem::directory_iterator(CHIP8EMU_TESTS_DIR)){
+        if(entry.path().extension() == ".ch8"){
+            paths.push_back(entry.path());
+        }
+    }
+    std::ranges::sort(paths);
+    for(const auto& path : paths){
+        std::ifstream in(path, std::ios::binary);
+        const std::vector<uint8_t> rom{std::istreambuf_iterator<char>(in), {}};
+        for(const auto q : {Chip8::quirks_t::cosmac_vip, Chip8::quirks_t::schip, Chip8::quirks_t::modern}){
+            if(!run(path.filename().string(), rom, q, ROM_FRAMES, backends)){
+                return 1;
+            }
+            ++roms;
+        }
+    }
+
+    // fixed seed, the same ROMs on every run
+    std::mt19937 gen(1);
+    for(int i = 0; i < RANDOM_ROMS; ++i){
+        const auto q = Chip8::quirks_t(i % 3);
+        if(!run("random ROM " + std::to_string(i), random_rom(gen), q, RANDOM_FRAMES, backends)){
+            return 1;
+        }
+        ++roms;
+    }
+
+    std::println("{} ROMs, {} backends: every backend matches the interpreter", roms, backends.size());
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <algorithm>
+
+#include "chip8.hpp"
+
+// the name of the first field that differs, nullptr if none does. The stack
+// only counts up to SP
+inline const char* compare(const Chip8::state_t& a, const Chip8::state_t& b){
+    if(a.screen != b.screen) return "screen";
+    if(a.ram != b.ram) return "ram";
+    if(a.SP != b.SP) return "SP";
+    if(!std::equal(a.stack.begin(), a.stack.begin() + a.SP, b.stack.begin())) return "stack";
+    if(a.fault != b.fault) return "fault";
+    if(a.PC != b.PC) return "PC";
+    if(a.I != b.I) return "I";
+    if(a.keyboard != b.keyboard) return "keyboard";
+    if(a.V != b.V) return "V";
+    if(a.delay_timer != b.delay_timer) return "delay_timer";
+    if(a.sound_timer != b.sound_timer) return "sound_timer";
+    if(a.quirks != b.quirks) return "quirks";
+    if(a.rng != b.rng) return "rng";
+    return nullptr;
+}
@@ -0,0 +1,180 @@
+#include "chip8.hpp"
+#include "lockstep.hpp"
+#include "compare_state.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <print>
+#include <random>
+#include <string>
+#include <vector>
+
+// every Lockstep lane against a separate Chip8 fed the same seed and keys,
+// the whole state_t compared after every frame. Exits with 1 on the first
+// difference
+
+namespace{
+
+constexpr size_t LANES = 7;
+constexpr int ROM_FRAMES = 600;
+constexpr int RANDOM_ROMS = 300;
+constexpr int RANDOM_FRAMES = 60;
+
+// lanes 0 and 1 share their seed and their keys, so some lanes stay
+// converged while the others diverge
+uint64_t lane_seed(size_t lane){
+    return lane < 2 ? 0 : lane;
+}
+
+uint16_t lane_keys(size_t lane, int frame){
+    if(lane < 2){
+        return 0;
+    }
+    // held for a few frames, then released
+    return (frame / 4 + lane) % 3 ? 0 : uint16_t(1) << ((frame / 12 + lane) % 16);
+}
+
+bool run(const std::string& name, const std::vector<uint8_t>& rom, Chip8::quirks_t q, int frames){
+    Lockstep lockstep(LANES);
+    lockstep.load(rom, q);
+    std::vector<Chip8> chips(LANES);
+    for(size_t l = 0; l < LANES; ++l){
+        chips[l].load(rom, q);
+        chips[l].seed(lane_seed(l));
+        lockstep.seed(l, lane_seed(l));
+    }
+
+    for(int f = 0; f < frames; ++f){
+        for(size_t l = 0; l < LANES; ++l){
+            chips[l].set_keyboard(lane_keys(l, f));
+            lockstep.set_keyboard(l, lane_keys(l, f));
+            chips[l].run_frame();
+        }
+        lockstep.run_frame();
+
+        for(size_t l = 0; l < LANES; ++l){
+            if(const char* field = compare(chips[l].snapshot(), lockstep.snapshot(l))){
+                std::println(stderr, "{}: lane {} differs in {} after frame {}", name, l, field, f);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// instructions with defined behavior only, in groups that jumps land on
+// as a whole. I is set right before anything uses it, so memory accesses
+// stay in ram
+std::vector<uint8_t> random_rom(std::mt19937& gen){
+    const int groups = 8 + gen() % 40;
+    // start address of every group
+    std::vector<uint16_t> starts;
+    // jump groups are a single 1NNN / 2NNN, NNN is filled in once every
+    // group has its address
+    struct group_t{
+        std::vector<uint16_t> ops;
+        bool jump = false;
+    };
+    std::vector<group_t> code(groups);
+    auto reg = [&]{ return uint16_t(gen() % 16); };
+    auto byte = [&]{ return uint16_t(gen() % 256); };
+    // anything that neither branches nor uses I, opcodes that aren't
+    // instructions included: they do nothing
+    auto plain = [&]() -> uint16_t{
+        constexpr std::array<uint16_t, 9> ALU{0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7, 0xE};
+        constexpr std::array<uint16_t, 4> NONE{0x0123, 0x8008, 0xE000, 0xF0FF};
+        switch(gen() % 9){
+            case 0: return 0x6000 | reg() << 8 | byte();
+            case 1: return 0x7000 | reg() << 8 | byte();
+            case 2: return 0xC000 | reg() << 8 | byte();
+            case 3: return 0xF007 | reg() << 8;
+            case 4: return 0xF015 | reg() << 8;
+            case 5: return 0xF018 | reg() << 8;
+            case 6: return NONE[gen() % NONE.size()] | reg() << 8 | (gen() % 6) << 4;
+        }
+        // X and Y often F, the flag has to win over the result
+        return 0x8000 | reg() << 8 | reg() << 4 | ALU[gen() % ALU.size()];
+    };
+
+    for(auto& [g, jump] : code){
+        switch(gen() % 10){
+            case 0:{
+                constexpr std::array<uint16_t, 6> SKIPS{0x3000, 0x4000, 0x5000, 0x9000, 0xE09E, 0xE0A1};
+                const uint16_t skip = SKIPS[gen() % SKIPS.size()];
+                const uint16_t operands = skip >> 12 == 0xE ? reg() << 8 : skip >> 12 <= 0x4 ? reg() << 8 | (gen() % 4) : reg() << 8 | reg() << 4;
+                g = {uint16_t(skip | operands), plain()};
+            }
+            break;
+            case 1:{
+                constexpr std::array<uint16_t, 6> MEMORY{0xD000, 0xF033, 0xF055, 0xF065, 0xF01E, 0xF029};
+                const uint16_t op = MEMORY[gen() % MEMORY.size()];
+                const uint16_t operands = op == 0xD000 ? reg() << 8 | reg() << 4 | (gen() % 16) : reg() << 8;
+                g = {uint16_t(0xA000 | (0x600 + gen() % 0x800)), uint16_t(op | operands)};
+            }
+            break;
+            case 2: g = {0x1000}; jump = true; break;
+            case 3: g = {0x2000}; jump = true; break;
+            case 4: g = {0x00EE}; break;
+            case 5: g = {gen() % 4 ? plain() : uint16_t(0x00E0)}; break;
+            case 6: g = {uint16_t(0xF00A | reg() << 8)}; break;
+            default: g = {plain(), plain()}; break;
+        }
+    }
+
+    uint16_t addr = 0x200;
+    for(const auto& g : code){
+        starts.push_back(addr);
+        addr += 2 * g.ops.size();
+    }
+    // back to the beginning at the end
+    code.push_back({{0x1200}});
+
+    std::vector<uint8_t> rom;
+    for(auto& [ops, jump] : code){
+        if(jump){
+            ops[0] |= starts[gen() % starts.size()];
+        }
+        for(const uint16_t op : ops){
+            rom.push_back(op >> 8);
+            rom.push_back(op & 0xFF);
+        }
+    }
+    return rom;
+}
+
+}
+
+int main(){
+    int roms = 0;
+    std::vector<std::filesystem::path> paths;
+    for(const auto& entry : std::filesystem::directory_iterator(CHIP8EMU_TESTS_DIR)){
+        if(entry.path().extension() == ".ch8"){
+            paths.push_back(entry.path());
+        }
+    }
+    std::ranges::sort(paths);
+    for(const auto& path : paths){
+        std::ifstream in(path, std::ios::binary);
+        const std::vector<uint8_t> rom{std::istreambuf_iterator<char>(in), {}};
+        for(const auto q : {Chip8::quirks_t::cosmac_vip, Chip8::quirks_t::schip, Chip8::quirks_t::modern}){
+            if(!run(path.filename().string(), rom, q, ROM_FRAMES)){
+                return 1;
+            }
+            ++roms;
+        }
+    }
+
+    // fixed seed, the same ROMs on every run
+    std::mt19937 gen(1);
+    for(int i = 0; i < RANDOM_ROMS; ++i){
+        const auto q = Chip8::quirks_t(i % 3);
+        if(!run("random ROM " + std::to_string(i), random_rom(gen), q, RANDOM_FRAMES)){
+            return 1;
+        }
+        ++roms;
+    }
+
+    std::println("{} ROMs, {} lanes each: every lane matches its Chip8", roms, LANES);
+}
@@ -0,0 +1,153 @@
+#include "batch.hpp"
+
+#include <charconv>
+#include <cstdio>
+#include <print>
+#include <random>
+#include <string_view>
+
+// runs a set of ROMs under several input sequences on every core
+
+namespace{
+
+void usage(){
+    std::println(stderr,
+        "usage: CHIP8emu_batch [--threads N] [--frames N] [--copies N] [--seed N] [--summary] "
+        "[--predecoded | --opcode-table | --threaded | --jit] [--vip | --schip] <rom>..."
+    );
+}
+
+bool parse_count(const char* s, uint64_t& out){
+    const std::string_view sv = s;
+    return std::from_chars(sv.data(), sv.data() + sv.size(), out).ec == std::errc{};
+}
+
+bool read_rom(const char* path, std::vector<uint8_t>& rom){
+    std::FILE* f = std::fopen(path, "rb");
+    if(!f){
+        return false;
+    }
+    for(int b; (b = std::fgetc(f)) != EOF;){
+        rom.push_back(b);
+    }
+    std::fclose(f);
+    return true;
+}
+
+// copy 0 never presses a key, the others get a random key every few frames
+std::vector<uint16_t> make_keys(uint64_t copy, uint64_t frames){
+    std::vector<uint16_t> keys;
+    if(copy == 0){
+        return keys;
+    }
+    std::mt19937 gen(copy);
+    std::uniform_int_distribution<int> key(0, 16); // 16: no key
+    std::uniform_int_distribution<int> hold(2, 20);
+    while(keys.size() < frames){
+        const int k = key(gen);
+        keys.insert(keys.end(), hold(gen), k < 16 ? 1 << k : 0);
+    }
+    return keys;
+}
+
+}
+
+int main(int argc, char** argv){
+    uint64_t threads = 0;
+    uint64_t frames = 600;
+    uint64_t copies = 1;
+    uint64_t seed = Chip8::DEFAULT_SEED;
+    bool summary = false;
+    Chip8::backend_t backend = Chip8::backend_t::interpreter;
+    Chip8::quirks_t quirks = Chip8::quirks_t::modern;
+    std::vector<const char*> paths;
+    for(int i = 1; i < argc; ++i){
+        const std::string_view arg = argv[i];
+        if(arg == "--threads" && i + 1 < argc && parse_count(argv[i + 1], threads)){
+            ++i;
+        }
+        else if(arg == "--frames" && i + 1 < argc && parse_count(argv[i + 1], frames)){
+            ++i;
+        }
+        else if(arg == "--copies" && i + 1 < argc && parse_count(argv[i + 1], copies)){
+            ++i;
+        }
+        else if(arg == "--seed" && i + 1 < argc && parse_count(argv[i + 1], seed)){
+            ++i;
+        }
+        else if(arg == "--summary"){
+            summary = true;
+        }
+        else if(arg == "--predecoded"){
+            backend = Chip8::backend_t::predecoded;
+        }
+        else if(arg == "--opcode-table"){
+            backend = Chip8::backend_t::opcode_table;
+        }
+        else if(arg == "--threaded"){
+            backend = Chip8::backend_t::threaded;
+        }
+        else if(arg == "--jit"){
+            backend = Chip8::backend_t::jit_x64;
+        }
+        else if(arg == "--vip"){
+            quirks = Chip8::quirks_t::cosmac_vip;
+        }
+        else if(arg == "--schip"){
+            quirks = Chip8::quirks_t::schip;
+        }
+        else if(arg.starts_with("--")){
+            usage();
+            return 1;
+        }
+        else{
+            paths.push_back(argv[i]);
+        }
+    }
+    if(paths.empty()){
+        usage();
+        return 1;
+    }
+
+    Batch batch(threads);
+    for(const char* path : paths){
+        std::vector<uint8_t> rom;
+        if(!read_rom(path, rom)){
+            std::println(stderr, "Couldn't open the file: {}", path);
+            return 1;
+        }
+        if(!Chip8().load(rom)){
+            std::println(stderr, "ROM too large: {} ({} bytes)", path, rom.size());
+            return 1;
+        }
+        for(uint64_t copy = 0; copy < copies; ++copy){
+            batch.add({
+                .rom = rom,
+                .quirks = quirks,
+                .backend = backend,
+                .frames = frames,
+                .keys = make_keys(copy, frames),
+                // copies differ in their random numbers too
+                .seed = seed + copy,
+            });
+        }
+    }
+
+    batch.run();
+
+    if(!summary){
+        const auto& results = batch.get_results();
+        for(size_t j = 0; j < results.size(); ++j){
+            const Batch::result_t& r = results[j];
+            std::println("{} #{}: {} instructions interpreted ({} fast-forwarded), {:.3f} ms, screen hash 0x{:016X}",
+                paths[j / copies], j % copies, r.instructions, r.skipped, r.seconds * 1e3, r.screen_hash
+            );
+        }
+    }
+
+    const Batch::stats_t& stats = batch.get_stats();
+    std::println("{} jobs, {} instructions interpreted in {:.3f} s: {:.0f} instructions/s ({} slices, {} steals)",
+        batch.get_results().size(), stats.instructions, stats.seconds,
+        stats.instructions_per_second, stats.slices, stats.steals
+    );
+}
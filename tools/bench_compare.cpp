@@ -0,0 +1,276 @@
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <print>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// compares two result files of CHIP8emu_bench --json, exits with 1 if a
+// benchmark got significantly slower
+
+namespace{
+
+void usage(){
+    std::println(stderr,
+        "usage: CHIP8emu_bench_compare <baseline.json> <candidate.json> "
+        "[--min-change PCT] [--sigmas K]"
+    );
+}
+
+// just enough JSON for the bench output: the samples of every benchmark
+class reader_t{
+    public:
+    explicit reader_t(std::string text) : text(std::move(text)) {}
+
+    // name -> samples, false on malformed input
+    bool read(std::map<std::string, std::vector<double>>& out){
+        skip_ws();
+        return parse_root(out) && (skip_ws(), pos == text.size());
+    }
+
+    private:
+    std::string text;
+    size_t pos = 0;
+
+    void skip_ws(){
+        while(pos < text.size() && std::string_view(" \t\r\n").contains(text[pos])){
+            ++pos;
+        }
+    }
+
+    bool eat(char c){
+        skip_ws();
+        if(pos < text.size() && text[pos] == c){
+            ++pos;
+            return true;
+        }
+        return false;
+    }
+
+    bool parse_string(std::string& s){
+        if(!eat('"')){
+            return false;
+        }
+        s.clear();
+        while(pos < text.size() && text[pos] != '"'){
+            // names don't need more than the escaped character itself
+            if(text[pos] == '\\' && pos + 1 < text.size()){
+                ++pos;
+            }
+            s += text[pos++];
+        }
+        return eat('"');
+    }
+
+    bool parse_number(double& d){
+        skip_ws();
+        const auto [end, ec] = std::from_chars(text.data() + pos, text.data() + text.size(), d);
+        if(ec != std::errc{}){
+            return false;
+        }
+        pos = end - text.data();
+        return true;
+    }
+
+    // skips any value
+    bool skip_value(){
+        skip_ws();
+        if(pos >= text.size()){
+            return false;
+        }
+        std::string s;
+        double d;
+        switch(text[pos]){
+            case '"': return parse_string(s);
+            case '{': return parse_object([this](const std::string&){ return skip_value(); });
+            case '[': return parse_array([this]{ return skip_value(); });
+            case 't': return literal("true");
+            case 'f': return literal("false");
+            case 'n': return literal("null");
+        }
+        return parse_number(d);
+    }
+
+    bool literal(std::string_view word){
+        if(std::string_view(text).substr(pos, word.size()) != word){
+            return false;
+        }
+        pos += word.size();
+        return true;
+    }
+
+    template<class F>
+    bool parse_object(F member){
+        if(!eat('{')){
+            return false;
+        }
+        if(eat('}')){
+            return true;
+        }
+        do{
+            std::string key;
+            if(!parse_string(key) || !eat(':') || !member(key)){
+                return false;
+            }
+        } while(eat(','));
+        return eat('}');
+    }
+
+    template<class F>
+    bool parse_array(F element){
+        if(!eat('[')){
+            return false;
+        }
+        if(eat(']')){
+            return true;
+        }
+        do{
+            if(!element()){
+                return false;
+            }
+        } while(eat(','));
+        return eat(']');
+    }
+
+    bool parse_root(std::map<std::string, std::vector<double>>& out){
+        return parse_object([&](const std::string& key){
+            if(key != "benchmarks"){
+                return skip_value();
+            }
+            return parse_array([&]{
+                std::string name;
+                std::vector<double> samples;
+                const bool ok = parse_object([&](const std::string& k){
+                    if(k == "name"){
+                        return parse_string(name);
+                    }
+                    if(k == "samples"){
+                        return parse_array([&]{
+                            double d;
+                            const bool number = parse_number(d);
+                            samples.push_back(d);
+                            return number;
+                        });
+                    }
+                    return skip_value();
+                });
+                if(ok && !name.empty() && !samples.empty()){
+                    out[name] = std::move(samples);
+                }
+                return ok;
+            });
+        });
+    }
+};
+
+bool load(const char* path, std::map<std::string, std::vector<double>>& out){
+    std::FILE* f = std::fopen(path, "rb");
+    if(!f){
+        return false;
+    }
+    std::string text;
+    for(int c; (c = std::fgetc(f)) != EOF;){
+        text += char(c);
+    }
+    std::fclose(f);
+    return reader_t(std::move(text)).read(out);
+}
+
+double median(std::vector<double> v){
+    std::ranges::sort(v);
+    const size_t mid = v.size() / 2;
+    return v.size() % 2 ? v[mid] : (v[mid - 1] + v[mid]) / 2;
+}
+
+// median absolute deviation
+double mad(const std::vector<double>& v, double med){
+    std::vector<double> dev;
+    for(double x : v){
+        dev.push_back(std::abs(x - med));
+    }
+    return median(std::move(dev));
+}
+
+bool parse_positive(const char* s, double& out){
+    const std::string_view sv = s;
+    return std::from_chars(sv.data(), sv.data() + sv.size(), out).ec == std::errc{} && out >= 0;
+}
+
+}
+
+int main(int argc, char** argv){
+    if(argc < 3){
+        usage();
+        return 2;
+    }
+
+    // changes below min_change are never reported, whatever the noise
+    double min_change = 2;
+    // how many standard deviations (estimated from the MADs) a change has to exceed
+    double sigmas = 3;
+    for(int i = 3; i < argc; ++i){
+        const std::string_view arg = argv[i];
+        if(arg == "--min-change" && i + 1 < argc && parse_positive(argv[i + 1], min_change)){
+            ++i;
+        }
+        else if(arg == "--sigmas" && i + 1 < argc && parse_positive(argv[i + 1], sigmas)){
+            ++i;
+        }
+        else{
+            usage();
+            return 2;
+        }
+    }
+
+    std::map<std::string, std::vector<double>> baseline, candidate;
+    for(const auto& [path, out] : {std::pair{argv[1], &baseline}, std::pair{argv[2], &candidate}}){
+        if(!load(path, *out)){
+            std::println(stderr, "Couldn't read the benchmark results: {}", path);
+            return 2;
+        }
+    }
+
+    int slower = 0;
+    int faster = 0;
+    std::println("{:<40} {:>12} {:>12} {:>9} {:>9}", "benchmark", "baseline", "candidate", "change", "noise");
+    for(const auto& [name, base] : baseline){
+        const auto it = candidate.find(name);
+        if(it == candidate.end()){
+            std::println("{:<40} {:>12.3f} {:>12}", name, median(base), "missing");
+            continue;
+        }
+        const std::vector<double>& cand = it->second;
+
+        const double base_median = median(base);
+        const double cand_median = median(cand);
+        // 1.4826 * MAD estimates the standard deviation of normal noise
+        // and isn't thrown off by the odd outlier sample
+        const double base_sigma = 1.4826 * mad(base, base_median);
+        const double cand_sigma = 1.4826 * mad(cand, cand_median);
+        const double change = 100 * (cand_median / base_median - 1);
+        const double noise = 100 * sigmas * std::hypot(base_sigma, cand_sigma) / base_median;
+        const double threshold = std::max(min_change, noise);
+
+        const char* verdict = "";
+        if(change > threshold){
+            verdict = "  SLOWER";
+            ++slower;
+        }
+        else if(change < -threshold){
+            verdict = "  faster";
+            ++faster;
+        }
+        std::println("{:<40} {:>12.3f} {:>12.3f} {:>+8.1f}% {:>8.1f}%{}", name, base_median, cand_median, change, noise, verdict);
+    }
+    for(const auto& [name, cand] : candidate){
+        if(!baseline.contains(name)){
+            std::println("{:<40} {:>12} {:>12.3f}", name, "new", median(cand));
+        }
+    }
+
+    std::println("\n{} slower, {} faster (threshold: {:.1f}% or {} sigmas of noise)", slower, faster, min_change, sigmas);
+    return slower ? 1 : 0;
+}
@@ -0,0 +1,205 @@
+#include "chip8.hpp"
+#include "perf_counters.hpp"
+
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <print>
+#include <string_view>
+
+// emulator without any frontend, for CI and throughput measurements
+
+namespace{
+
+void usage(){
+    std::println(stderr,
+        "usage: CHIP8emu_headless <rom> [--frames N | --instructions N] "
+        "[--predecoded | --opcode-table | --threaded | --jit] [--vip | --schip] [--seed N] [--profile out.json] "
+        "[--trace out.c8t [--trace-records N]] [--perf]"
+    );
+}
+
+bool parse_count(const char* s, uint64_t& out){
+    const std::string_view sv = s;
+    return std::from_chars(sv.data(), sv.data() + sv.size(), out).ec == std::errc{};
+}
+
+}
+
+int main(int argc, char** argv){
+    if(argc < 2){
+        usage();
+        return 1;
+    }
+
+    std::FILE* f = std::fopen(argv[1], "rb");
+    if(!f){
+        std::println(stderr, "Couldn't open the file: {}", argv[1]);
+        return 1;
+    }
+    std::vector<uint8_t> rom;
+    for(int b; (b = std::fgetc(f)) != EOF;){
+        rom.push_back(b);
+    }
+    std::fclose(f);
+
+    uint64_t frames = 600;
+    uint64_t instructions = 0; // 0: run frames
+    Chip8::backend_t backend = Chip8::backend_t::interpreter;
+    Chip8::quirks_t quirks = Chip8::quirks_t::modern;
+    uint64_t seed = Chip8::DEFAULT_SEED;
+#ifdef CHIP8EMU_PROFILE
+    const char* profile_path = nullptr;
+#endif
+    const char* trace_path = nullptr;
+    uint64_t trace_records = 1 << 20;
+    bool perf = false;
+    for(int i = 2; i < argc; ++i){
+        const std::string_view arg = argv[i];
+        if(arg == "--frames" && i + 1 < argc && parse_count(argv[i + 1], frames)){
+            instructions = 0;
+            ++i;
+        }
+        else if(arg == "--instructions" && i + 1 < argc && parse_count(argv[i + 1], instructions)){
+            ++i;
+        }
+        else if(arg == "--seed" && i + 1 < argc && parse_count(argv[i + 1], seed)){
+            ++i;
+        }
+        else if(arg == "--profile" && i + 1 < argc){
+#ifdef CHIP8EMU_PROFILE
+            profile_path = argv[++i];
+#else
+            std::println(stderr, "--profile needs a build with -DCHIP8EMU_PROFILE=ON");
+            return 1;
+#endif
+        }
+        else if(arg == "--trace" && i + 1 < argc){
+            trace_path = argv[++i];
+        }
+        else if(arg == "--trace-records" && i + 1 < argc && parse_count(argv[i + 1], trace_records)){
+            ++i;
+        }
+        else if(arg == "--perf"){
+            perf = true;
+        }
+        else if(arg == "--predecoded"){
+            backend = Chip8::backend_t::predecoded;
+        }
+        else if(arg == "--opcode-table"){
+            backend = Chip8::backend_t::opcode_table;
+        }
+        else if(arg == "--threaded"){
+            backend = Chip8::backend_t::threaded;
+        }
+        else if(arg == "--jit"){
+            backend = Chip8::backend_t::jit_x64;
+        }
+        else if(arg == "--vip"){
+            quirks = Chip8::quirks_t::cosmac_vip;
+        }
+        else if(arg == "--schip"){
+            quirks = Chip8::quirks_t::schip;
+        }
+        else{
+            usage();
+            return 1;
+        }
+    }
+
+    Chip8 c;
+    if(!c.load(rom, quirks)){
+        std::println(stderr, "ROM too large: {} bytes", rom.size());
+        return 1;
+    }
+    c.seed(seed);
+    if(!c.set_backend(backend)){
+        std::println(stderr, "Backend not available on this host, using the interpreter");
+    }
+
+    // the last trace_records instructions, written straight to the file
+    std::unique_ptr<Tracer> tracer;
+    if(trace_path){
+        tracer = std::make_unique<Tracer>(trace_path, trace_records);
+        if(!tracer->is_open()){
+            std::println(stderr, "Couldn't map the trace file: {}", trace_path);
+            return 1;
+        }
+        c.set_tracer(tracer.get());
+    }
+
+    // opened before the run, that takes a few syscalls
+    std::unique_ptr<PerfCounters> counters;
+    if(perf){
+        counters = std::make_unique<PerfCounters>();
+        if(!counters->available()){
+            std::println(stderr, "Performance counters not available on this host");
+            counters.reset();
+        }
+    }
+
+    uint64_t executed = 0;
+    if(counters){
+        counters->start();
+    }
+    const auto start = std::chrono::steady_clock::now();
+    if(instructions == 0){
+        for(uint64_t i = 0; i < frames; ++i){
+            executed += c.run_frame();
+        }
+    }
+    else{
+        const int per_frame = c.get_cycles_per_frame();
+        while(executed + per_frame <= instructions){
+            executed += c.run_frame();
+        }
+        // last partial frame, no timer tick
+        while(executed < instructions){
+            executed += c.run_cycles(instructions - executed);
+        }
+    }
+    const auto end = std::chrono::steady_clock::now();
+    if(counters){
+        counters->stop();
+    }
+
+    const double seconds = std::chrono::duration<double>(end - start).count();
+    const uint64_t skipped = c.get_skipped_cycles();
+    // fast-forwarded instructions cost nothing, they'd only inflate the
+    // throughput and dilute the host events
+    const uint64_t interpreted = executed - skipped;
+    std::println("instructions: {} ({} interpreted, {} fast-forwarded)", executed, interpreted, skipped);
+    std::println("time: {:.6f} s", seconds);
+    std::println("throughput: {:.0f} interpreted instructions/s", interpreted / seconds);
+    std::println("screen hash: 0x{:016X}", c.get_screen_hash());
+    if(counters && interpreted > 0){
+        const PerfCounters::counts_t counts = counters->read();
+        std::println("host events per interpreted instruction:");
+        for(int e = 0; e < PerfCounters::EVENTS; ++e){
+            if(counts[e] < 0){
+                std::println("  {}: unavailable", PerfCounters::EVENT_NAMES[e]);
+            }
+            else{
+                std::println("  {}: {:.3f}", PerfCounters::EVENT_NAMES[e], double(counts[e]) / interpreted);
+            }
+        }
+    }
+    switch(c.get_fault()){
+        case Chip8::fault_t::none: break;
+        case Chip8::fault_t::stack_overflow: std::println("fault: stack overflow"); break;
+        case Chip8::fault_t::stack_underflow: std::println("fault: stack underflow"); break;
+    }
+
+#ifdef CHIP8EMU_PROFILE
+    if(profile_path){
+        std::FILE* out = std::fopen(profile_path, "w");
+        if(!out){
+            std::println(stderr, "Couldn't open the file: {}", profile_path);
+            return 1;
+        }
+        c.get_profile().write_json(out);
+        std::fclose(out);
+    }
+#endif
+}
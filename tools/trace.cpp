@@ -0,0 +1,118 @@
+#include "profile.hpp"
+#include "tracer.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <print>
+#include <string_view>
+
+// decodes traces written by Tracer (headless --trace), or diffs two of them
+
+namespace{
+
+void usage(){
+    std::println(stderr,
+        "usage: CHIP8emu_trace <trace> [--last N]\n"
+        "       CHIP8emu_trace <trace> --diff <other trace> [--context N]"
+    );
+}
+
+bool parse_count(const char* s, uint64_t& out){
+    const std::string_view sv = s;
+    return std::from_chars(sv.data(), sv.data() + sv.size(), out).ec == std::errc{};
+}
+
+void print_record(uint64_t n, const Tracer::record_t& r, std::string_view prefix = ""){
+    std::print("{}{:>10}  {:03X}  {:04X}  {:<7}  I={:03X}", prefix, n, r.PC, r.opcode, Profile::CLASS_NAMES[Profile::classify(r.opcode)], r.I);
+    if(r.reg != Tracer::NO_REG){
+        std::print("  V{:X}={:02X}", r.reg, r.value);
+    }
+    std::println("");
+}
+
+bool same(const Tracer::record_t& a, const Tracer::record_t& b){
+    return a.PC == b.PC && a.opcode == b.opcode && a.I == b.I && a.reg == b.reg && a.value == b.value;
+}
+
+}
+
+int main(int argc, char** argv){
+    if(argc < 2){
+        usage();
+        return 1;
+    }
+
+    uint64_t last = 0; // 0: everything
+    uint64_t context = 8;
+    const char* other_path = nullptr;
+    for(int i = 2; i < argc; ++i){
+        const std::string_view arg = argv[i];
+        if(arg == "--last" && i + 1 < argc && parse_count(argv[i + 1], last)){
+            ++i;
+        }
+        else if(arg == "--context" && i + 1 < argc && parse_count(argv[i + 1], context)){
+            ++i;
+        }
+        else if(arg == "--diff" && i + 1 < argc){
+            other_path = argv[++i];
+        }
+        else{
+            usage();
+            return 1;
+        }
+    }
+
+    std::vector<Tracer::record_t> a;
+    uint64_t a_first;
+    if(!Tracer::load(argv[1], a, a_first)){
+        std::println(stderr, "Couldn't read the trace: {}", argv[1]);
+        return 1;
+    }
+
+    if(!other_path){
+        const size_t from = last && last < a.size() ? a.size() - last : 0;
+        for(size_t i = from; i < a.size(); ++i){
+            print_record(a_first + i, a[i]);
+        }
+        return 0;
+    }
+
+    std::vector<Tracer::record_t> b;
+    uint64_t b_first;
+    if(!Tracer::load(other_path, b, b_first)){
+        std::println(stderr, "Couldn't read the trace: {}", other_path);
+        return 1;
+    }
+
+    // records are compared by number, over the part both rings still hold
+    const uint64_t first = std::max(a_first, b_first);
+    const uint64_t end = std::min(a_first + a.size(), b_first + b.size());
+    if(first >= end){
+        std::println("no records in common: {} [{}, {}), {} [{}, {})",
+            argv[1], a_first, a_first + a.size(), other_path, b_first, b_first + b.size());
+        return 1;
+    }
+
+    uint64_t n = first;
+    while(n < end && same(a[n - a_first], b[n - b_first])){
+        ++n;
+    }
+    if(n == end){
+        std::println("same records [{}, {})", first, end);
+        // one may still go on further than the other
+        return a_first + a.size() == b_first + b.size() ? 0 : 1;
+    }
+
+    std::println("first difference at record {}", n);
+    const uint64_t from = n - std::min(n - first, context);
+    for(uint64_t i = from; i < n; ++i){
+        print_record(i, a[i - a_first], "  ");
+    }
+    const uint64_t to = std::min(end, n + context);
+    for(uint64_t i = n; i < to; ++i){
+        print_record(i, a[i - a_first], "< ");
+        print_record(i, b[i - b_first], "> ");
+    }
+    return 1;
+}
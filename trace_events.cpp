@@ -0,0 +1,80 @@
+#include "trace_events.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <print>
+
+TraceEvents::scope_t::scope_t(TraceEvents* events, int track, const char* name) :
+    events(events),
+    track(track),
+    name(name)
+{
+    if(events){
+        start = clock::now();
+    }
+}
+
+TraceEvents::scope_t::~scope_t(){
+    if(events){
+        const int64_t start_ns = events->since_origin(start);
+        events->record(track, {name, start_ns, events->since_origin(clock::now()) - start_ns, 0});
+    }
+}
+
+TraceEvents::TraceEvents(std::initializer_list<const char*> track_names, size_t max_events) :
+    max_events(max_events)
+{
+    for(const char* name : track_names){
+        tracks.push_back({name, {}});
+        // most of it up front, growing the vector mid-frame would show up in the timings
+        tracks.back().events.reserve(std::min<size_t>(max_events, 1 << 16));
+    }
+}
+
+void TraceEvents::instant(int track, const char* name, int64_t value){
+    record(track, {name, since_origin(clock::now()), -1, value});
+}
+
+void TraceEvents::record(int track, const event_t& e){
+    auto& events = tracks[track].events;
+    if(events.size() < max_events){
+        events.push_back(e);
+    }
+}
+
+int64_t TraceEvents::since_origin(clock::time_point t) const{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(t - origin).count();
+}
+
+bool TraceEvents::write_json(const char* path) const{
+    std::FILE* f = std::fopen(path, "w");
+    if(!f){
+        return false;
+    }
+
+    // timestamps are in microseconds
+    std::println(f, "{{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+    bool first = true;
+    auto separator = [&]{
+        const char* s = first ? "" : ",\n";
+        first = false;
+        return s;
+    };
+    for(size_t t = 0; t < tracks.size(); ++t){
+        std::print(f, "{}{{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": {}, \"args\": {{\"name\": \"{}\"}}}}",
+            separator(), t, tracks[t].name);
+        for(const event_t& e : tracks[t].events){
+            if(e.duration_ns < 0){
+                std::print(f, "{}{{\"name\": \"{}\", \"ph\": \"i\", \"s\": \"t\", \"pid\": 1, \"tid\": {}, \"ts\": {:.3f}, \"args\": {{\"value\": {}}}}}",
+                    separator(), e.name, t, e.start_ns / 1e3, e.value);
+            }
+            else{
+                std::print(f, "{}{{\"name\": \"{}\", \"ph\": \"X\", \"pid\": 1, \"tid\": {}, \"ts\": {:.3f}, \"dur\": {:.3f}}}",
+                    separator(), e.name, t, e.start_ns / 1e3, e.duration_ns / 1e3);
+            }
+        }
+    }
+    std::println(f, "\n]}}");
+
+    return std::fclose(f) == 0;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+class TraceEvents{
+    /*
+        Timings of the phases of the frontend loops, written as Chrome
+        trace-event JSON (chrome://tracing, https://ui.perfetto.dev).
+
+        Each thread records into its own track, so recording takes no lock.
+        A track stops recording once it holds max_events events, which
+        bounds the memory of long sessions.
+    */
+
+    public:
+    using clock = std::chrono::steady_clock;
+
+    // times the enclosing scope. Does nothing if events is nullptr
+    class scope_t{
+        public:
+        scope_t(TraceEvents* events, int track, const char* name);
+        ~scope_t();
+        scope_t(const scope_t&) = delete;
+        scope_t& operator=(const scope_t&) = delete;
+
+        private:
+        TraceEvents* events;
+        int track;
+        const char* name;
+        clock::time_point start;
+    };
+
+    // one track per name, the names show up as thread names
+    explicit TraceEvents(std::initializer_list<const char*> track_names, size_t max_events = 1 << 20);
+
+    // a point in time on track, with an optional value shown as its argument
+    void instant(int track, const char* name, int64_t value = 0);
+    // to be called once no thread records anymore
+    bool write_json(const char* path) const;
+
+    private:
+    struct event_t{
+        const char* name; // string literals only
+        int64_t start_ns;
+        int64_t duration_ns; // < 0 for instant events
+        int64_t value;
+    };
+
+    struct track_t{
+        const char* name;
+        std::vector<event_t> events;
+    };
+
+    clock::time_point origin = clock::now();
+    size_t max_events;
+    std::vector<track_t> tracks;
+
+    void record(int track, const event_t& e);
+    int64_t since_origin(clock::time_point t) const;
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+template<class T>
+class TripleBuffer{
+    /*
+        Lock-free handoff from one producer thread to one consumer thread.
+        The producer fills its back buffer and publishes it by swapping it
+        with the middle one, the consumer swaps the middle buffer with its
+        front one when a fresh one is there. The producer never waits, the
+        consumer just sees the latest published buffer and can block in
+        wait() when it has nothing else to do until there's a fresh one.
+    */
+
+    static constexpr uint8_t INDEX_MASK = 0x3;
+    static constexpr uint8_t FRESH = 0x4;
+
+    std::array<T, 3> buffers{};
+    // index of the middle buffer, | FRESH if it wasn't consumed yet
+    alignas(64) std::atomic<uint8_t> middle{1};
+    alignas(64) uint8_t back = 0; // producer only
+    alignas(64) uint8_t front = 2; // consumer only
+
+    public:
+    // producer side
+    T& back_buffer(){
+        return buffers[back];
+    }
+
+    // returns false if the buffer published before was never consumed,
+    // it was dropped in favour of this one
+    bool publish(){
+        const uint8_t previous = middle.exchange(back | FRESH, std::memory_order_acq_rel);
+        middle.notify_one();
+        back = previous & INDEX_MASK;
+        return !(previous & FRESH);
+    }
+
+    // consumer side, returns true if front_buffer() changed
+    bool update(){
+        if(!(middle.load(std::memory_order_relaxed) & FRESH)){
+            return false;
+        }
+        front = middle.exchange(front, std::memory_order_acq_rel) & INDEX_MASK;
+        return true;
+    }
+
+    // blocks until update() has a fresh buffer to take. Nothing else ends
+    // the wait: to stop a waiting consumer, the producer publishes once more
+    void wait() const{
+        for(uint8_t m = middle.load(std::memory_order_relaxed); !(m & FRESH); m = middle.load(std::memory_order_relaxed)){
+            middle.wait(m, std::memory_order_relaxed);
+        }
+    }
+
+    const T& front_buffer() const{
+        return buffers[front];
+    }
+};